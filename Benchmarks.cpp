@@ -0,0 +1,304 @@
+#include "Benchmarks.h"
+#include "CompilerParser.h"
+#include "FileLoader.h"
+#include "FileUtil.h"
+#include "StringInterner.h"
+#include "Tokenizer.h"
+#include "TreeRenderer.h"
+#include "TreeIndex.h"
+
+#include <chrono>
+#include <list>
+#include <fcntl.h>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Run a function on a number of threads and time it
+ * @param threads The number of threads
+ * @param fn The function to run, given the thread's index
+ * @return The elapsed time in seconds
+ */
+template <typename Fn>
+static double timeThreads(int threads, Fn fn) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread(fn, t));
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Compare interning a stream of identifiers with the lock-free
+ * StringInterner against a mutex-guarded hash map, from 1 to maxThreads
+ * threads. Every thread interns the whole stream, as parser threads working
+ * on files with the same identifiers would.
+ * @param out The stream to write results to
+ * @param maxThreads The most threads to run, or 0 for one per core
+ */
+void Benchmarks::internScaling(ostream& out, int maxThreads) {
+    if (maxThreads <= 0) {
+        maxThreads = max(1u, thread::hardware_concurrency());
+    }
+    const int distinct = 50000;
+    const int requests = 1000000;
+    mt19937 random(42);
+    vector<string> names;
+    for (int i = 0; i < distinct; i++) {
+        names.push_back("identifier" + to_string(random() % 1000000));
+    }
+    vector<const string*> stream;
+    for (int i = 0; i < requests; i++) {
+        stream.push_back(&names[random() % distinct]);
+    }
+
+    out << "threads  lock-free Mops/s  mutex Mops/s\n";
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        StringInterner interner(4096);
+        double lockFree = timeThreads(threads, [&](int t) {
+            for (int i = 0; i < requests; i++) {
+                interner.intern(*stream[(i + t * 7919) % requests]);
+            }
+        });
+
+        mutex lock;
+        unordered_map<string, uint32_t> table;
+        double locked = timeThreads(threads, [&](int t) {
+            for (int i = 0; i < requests; i++) {
+                const string& s = *stream[(i + t * 7919) % requests];
+                lock_guard<mutex> guard(lock);
+                table.emplace(s, (uint32_t) table.size());
+            }
+        });
+
+        double total = (double) requests * threads / 1e6;
+        out << threads << "  " << total / lockFree << "  " << total / locked << "\n";
+        if (threads * 2 > maxThreads) {
+            out << interner.report();
+        }
+    }
+}
+
+/**
+ * Ask the kernel to drop a set of files from the page cache, so the next
+ * read of them goes to the disk
+ * @param files The files to drop
+ */
+static void dropFromCache(const vector<string>& files) {
+    for (const string& path : files) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+/**
+ * Compare ways of loading many small source files: one at a time with
+ * blocking reads, on a pool of threads with pread, and batched through
+ * io_uring. Each is timed with the files dropped from the page cache and
+ * again with them cached. The files are generated in dir if it has none.
+ * @param out The stream to write results to
+ * @param dir The directory holding the files
+ * @param count The number of files to generate
+ */
+void Benchmarks::fileLoading(ostream& out, const string& dir, int count) {
+    vector<string> files = FileUtil::listJackFiles(dir);
+    if (files.empty()) {
+        mkdir(dir.c_str(), 0755);
+        for (int i = 0; i < count; i++) {
+            string name = "Class" + to_string(i);
+            string source = "class " + name + " {\n"
+                "    field int x, y;\n"
+                "    method int sum(int a) {\n"
+                "        var int total;\n"
+                "        let total = x + y + a;\n"
+                "        return total;\n"
+                "    }\n"
+                "}\n";
+            FileUtil::writeFile(dir + "/" + name + ".jack", source);
+        }
+        files = FileUtil::listJackFiles(dir);
+    }
+
+    size_t bytes = 0;
+    size_t unreadable = 0;
+    auto sequential = [&]() {
+        bytes = 0;
+        unreadable = 0;
+        for (const string& path : files) {
+            string source;
+            if (!FileUtil::readFile(path, source)) {
+                unreadable++;
+            }
+            bytes += source.size();
+        }
+    };
+    auto batched = [&](bool useIoUring) {
+        return [&, useIoUring]() {
+            FileLoader loader(64, 0);
+            loader.setUseIoUring(useIoUring);
+            bytes = 0;
+            unreadable = 0;
+            loader.load(files, [&](size_t, string& contents, bool ok) {
+                bytes += contents.size();
+                unreadable += ok ? 0 : 1;
+            });
+            return loader.usedIoUring();
+        };
+    };
+
+    out << files.size() << " files\n";
+    out << "method  cold files/s  warm files/s\n";
+    for (int method = 0; method < 3; method++) {
+        double seconds[2];
+        bool available = true;
+        for (int warm = 0; warm < 2; warm++) {
+            if (!warm) {
+                dropFromCache(files);
+            }
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            if (method == 0) {
+                sequential();
+            } else {
+                available = batched(method == 2)() == (method == 2);
+            }
+            seconds[warm] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        const char* names[] = {"sequential", "pread pool", "io_uring"};
+        out << names[method] << "  ";
+        if (!available) {
+            out << "unavailable\n";
+            continue;
+        }
+        out << files.size() / seconds[0] << "  " << files.size() / seconds[1] << "\n";
+    }
+    out << bytes << " bytes per pass\n";
+    if (unreadable > 0) {
+        out << unreadable << " files could not be read\n";
+    }
+}
+
+/**
+ * Generate the source of a large class for the tree benchmarks
+ * @param subroutines The number of subroutines in the class
+ * @return The class's source
+ */
+static string bigClass(int subroutines) {
+    string source = "class Big {\n";
+    for (int i = 0; i < subroutines; i++) {
+        source += "    function int f" + to_string(i) + "(int a) {\n"
+            "        var int b;\n"
+            "        let b = a + 1;\n"
+            "        if (b > 2) { let b = b * 2; } else { do Big.f0(b); }\n"
+            "        while (b < 100) { let b = b + a; }\n"
+            "        return b;\n"
+            "    }\n";
+    }
+    return source + "}\n";
+}
+
+/**
+ * Compare finding nodes by walking a tree with getChildren() against the
+ * TreeIndex, for the first query and for the same query repeated. The tree
+ * is a generated class with many subroutines.
+ * @param out The stream to write results to
+ */
+void Benchmarks::treeQueries(ostream& out) {
+    const int repeats = 100;
+    string source = bigClass(2000);
+
+    list<Token*> tokens = Tokenizer::tokenize(source);
+    TreeIndex index;
+    CompilerParser parser(tokens);
+    parser.setIndex(&index);
+    ParseTree* tree = parser.compileClass();
+
+    size_t walked = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        walked = 0;
+        vector<ParseTree*> stack(1, tree);
+        while (!stack.empty()) {
+            ParseTree* node = stack.back();
+            stack.pop_back();
+            if (node->getType() == "letStatement") {
+                walked++;
+            }
+            for (ParseTree* child : node->getChildren()) {
+                stack.push_back(child);
+            }
+        }
+    }
+    double walk = chrono::duration<double>(chrono::steady_clock::now() - start).count() / repeats;
+
+    const string selector = "class/Subroutine/subroutineBody//letStatement";
+    start = chrono::steady_clock::now();
+    size_t selected = index.select(selector).size();
+    double first = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        selected = index.select(selector).size();
+    }
+    double repeated = chrono::duration<double>(chrono::steady_clock::now() - start).count() / repeats;
+
+    out << index.getNodeCount() << " nodes, " << walked << " letStatements walked, " << selected << " selected\n";
+    out << "walk  " << walk * 1e6 << " us\n";
+    out << "index first query  " << first * 1e6 << " us\n";
+    out << "index repeated query  " << repeated * 1e6 << " us\n";
+
+    delete tree;
+    for (Token* token : tokens) {
+        delete token;
+    }
+}
+
+/**
+ * Compare ParseTree::tostring() against the TreeRenderer on 1 to
+ * maxThreads threads, printing a generated class of about a million nodes.
+ * Every output is checked against tostring().
+ * @param out The stream to write results to
+ * @param maxThreads The most threads to run, or 0 for one per core
+ */
+void Benchmarks::rendering(ostream& out, int maxThreads) {
+    if (maxThreads <= 0) {
+        maxThreads = max(1u, thread::hardware_concurrency());
+    }
+    list<Token*> tokens = Tokenizer::tokenize(bigClass(10000));
+    CompilerParser parser(tokens);
+    ParseTree* tree = parser.compileClass();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    string expected = tree->tostring();
+    double serial = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    out << expected.size() << " bytes\n";
+    out << "threads  ms  speedup over tostring()\n";
+    out << "tostring  " << serial * 1000 << "  1\n";
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        TreeRenderer renderer(threads);
+        start = chrono::steady_clock::now();
+        string rendered = renderer.render(tree);
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        out << threads << "  " << elapsed * 1000 << "  " << serial / elapsed
+            << (rendered == expected ? "" : "  MISMATCH") << "\n";
+    }
+
+    delete tree;
+    for (Token* token : tokens) {
+        delete token;
+    }
+}
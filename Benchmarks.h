@@ -0,0 +1,19 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <ostream>
+#include <string>
+
+/**
+ * Scalability benchmarks run from the command line. Each writes a table
+ * of results to the given stream.
+ */
+class Benchmarks {
+    public:
+        static void internScaling(std::ostream& out, int maxThreads);
+        static void fileLoading(std::ostream& out, const std::string& dir, int count);
+        static void treeQueries(std::ostream& out);
+        static void rendering(std::ostream& out, int maxThreads);
+};
+
+#endif /*BENCHMARKS_H*/
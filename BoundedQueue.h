@@ -0,0 +1,129 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Fixed-capacity queue connecting one producer thread to one consumer
+ * thread. push() waits while the queue is full, which applies backpressure
+ * to the producer; pop() waits while it is empty. Items move through a ring
+ * of slots with atomic head and tail indices and no lock. A thread that has
+ * to wait spins briefly, then blocks on a mutex and condition variable; the
+ * other side only takes the mutex to signal it when it sees that the
+ * waiting thread is asleep.
+ */
+template <typename T>
+class BoundedQueue {
+    private:
+        std::vector<T> slots;
+        std::size_t mask;
+        std::atomic<std::size_t> head;
+        std::atomic<std::size_t> tail;
+        std::atomic<bool> closed;
+
+        // Yields before a waiting thread goes to sleep
+        static const int SPINS = 64;
+        std::mutex sleepLock;
+        std::condition_variable wakeUp;
+        std::atomic<bool> producerAsleep;
+        std::atomic<bool> consumerAsleep;
+
+        /**
+         * Wait until a condition holds, spinning first and then sleeping
+         * @param asleep The flag telling the other side this thread sleeps
+         * @param ready The condition
+         */
+        template <typename Ready>
+        void waitUntil(std::atomic<bool>& asleep, Ready ready) {
+            for (int i = 0; i < SPINS; i++) {
+                if (ready()) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lock(sleepLock);
+            asleep.store(true, std::memory_order_relaxed);
+            // Pairs with the fence in wake(): either this thread sees the
+            // other side's change, or the other side sees the flag
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wakeUp.wait(lock, ready);
+            asleep.store(false, std::memory_order_relaxed);
+        }
+
+        /**
+         * Wake the other side if it is asleep. Called after every change.
+         * @param asleep The other side's flag
+         */
+        void wake(std::atomic<bool>& asleep) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (asleep.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(sleepLock);
+                wakeUp.notify_all();
+            }
+        }
+
+    public:
+        /**
+         * Constructor for the BoundedQueue
+         * @param capacity The most items held at once, rounded up to a power of two
+         */
+        BoundedQueue(std::size_t capacity)
+                : head(0), tail(0), closed(false), producerAsleep(false), consumerAsleep(false) {
+            std::size_t size = 1;
+            while (size < capacity) {
+                size *= 2;
+            }
+            slots.resize(size);
+            mask = size - 1;
+        }
+
+        /**
+         * Add an item, waiting for space if the queue is full. Producer only.
+         * @param item The item to add
+         */
+        void push(T item) {
+            std::size_t t = tail.load(std::memory_order_relaxed);
+            waitUntil(producerAsleep, [&]() {
+                return t - head.load(std::memory_order_acquire) <= mask;
+            });
+            slots[t & mask] = std::move(item);
+            tail.store(t + 1, std::memory_order_release);
+            wake(consumerAsleep);
+        }
+
+        /**
+         * Remove the oldest item, waiting for one if the queue is empty. Consumer only.
+         * @param item Set to the removed item
+         * @return true if an item was removed, false if the queue is closed and empty
+         */
+        bool pop(T& item) {
+            std::size_t h = head.load(std::memory_order_relaxed);
+            waitUntil(consumerAsleep, [&]() {
+                return h != tail.load(std::memory_order_acquire) || closed.load(std::memory_order_acquire);
+            });
+            // Items pushed before close() are visible once closed is
+            if (h == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            item = std::move(slots[h & mask]);
+            head.store(h + 1, std::memory_order_release);
+            wake(producerAsleep);
+            return true;
+        }
+
+        /**
+         * Mark that no more items will be pushed. Producer only.
+         */
+        void close() {
+            closed.store(true, std::memory_order_release);
+            wake(consumerAsleep);
+        }
+};
+
+#endif /*BOUNDEDQUEUE_H*/
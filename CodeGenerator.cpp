@@ -0,0 +1,368 @@
+#include "CodeGenerator.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+/**
+ * Get the children of a node
+ * @param node The node
+ * @return The node's children, in order
+ */
+static vector<ParseTree*> childrenOf(ParseTree* node) {
+    return vector<ParseTree*>(node->childBegin(), node->childEnd());
+}
+
+/**
+ * Constructor for the CodeGenerator
+ */
+CodeGenerator::CodeGenerator() {
+    labelCount = 0;
+}
+
+/**
+ * Add a variable to the class or subroutine scope
+ * @param name The variable's name
+ * @param type The variable's type
+ * @param kind Where the variable lives
+ */
+void CodeGenerator::define(const string& name, const string& type, Kind kind) {
+    map<string, Symbol>& scope = (kind == STATIC || kind == FIELD) ? classScope : subroutineScope;
+    if (scope.count(name) != 0) {
+        throw CodeGenException(className + ": " + name + " is declared twice");
+    }
+    scope[name] = Symbol{type, kind, counts[kind]++};
+}
+
+/**
+ * Find a variable, looking in the subroutine scope first
+ * @param name The variable's name
+ * @return The variable, or NULL if it is not declared
+ */
+const CodeGenerator::Symbol* CodeGenerator::lookup(const string& name) {
+    map<string, Symbol>::iterator it = subroutineScope.find(name);
+    if (it != subroutineScope.end()) {
+        return &it->second;
+    }
+    it = classScope.find(name);
+    if (it != classScope.end()) {
+        return &it->second;
+    }
+    return NULL;
+}
+
+/**
+ * Get the VM memory segment for a kind of variable
+ * @param kind The kind of variable
+ * @return The segment's name
+ */
+string CodeGenerator::segment(Kind kind) {
+    switch (kind) {
+        case STATIC: return "static";
+        case FIELD: return "this";
+        case ARGUMENT: return "argument";
+        default: return "local";
+    }
+}
+
+/**
+ * Translate a class into VM code
+ * @param tree A tree produced by CompilerParser::compileClass()
+ * @return The VM code, one command per line
+ */
+string CodeGenerator::compileClass(ParseTree* tree) {
+    vector<ParseTree*> children = childrenOf(tree);
+    if (tree->getType() != "class" || children.size() < 3) {
+        throw CodeGenException("expected a class");
+    }
+    className = children[1]->getValue();
+    classScope.clear();
+    counts[STATIC] = 0;
+    counts[FIELD] = 0;
+
+    string out;
+    for (ParseTree* member : children) {
+        if (member->getType() == "classVarDec") {
+            vector<ParseTree*> dec = childrenOf(member);
+            Kind kind = dec[0]->getValue() == "static" ? STATIC : FIELD;
+            for (size_t i = 2; i < dec.size(); i += 2) {
+                define(dec[i]->getValue(), dec[1]->getValue(), kind);
+            }
+        } else if (member->getType() == "Subroutine") {
+            compileSubroutine(member, out);
+        }
+    }
+    return out;
+}
+
+/**
+ * Translate a subroutine into VM code
+ * @param subroutine A Subroutine tree
+ * @param out The VM code to append to
+ */
+void CodeGenerator::compileSubroutine(ParseTree* subroutine, string& out) {
+    vector<ParseTree*> children = childrenOf(subroutine);
+    string kind = children[0]->getValue();
+    string name = children[2]->getValue();
+    subroutineScope.clear();
+    counts[ARGUMENT] = 0;
+    counts[LOCAL] = 0;
+    labelCount = 0;
+
+    if (kind == "method") {
+        define("this", className, ARGUMENT);
+    }
+    if (children[4]->getType() == "parameterList") {
+        vector<ParseTree*> parameters = childrenOf(children[4]);
+        for (size_t i = 0; i + 1 < parameters.size(); i += 3) {
+            define(parameters[i + 1]->getValue(), parameters[i]->getValue(), ARGUMENT);
+        }
+    }
+
+    ParseTree* statements = NULL;
+    for (ParseTree* part : childrenOf(children.back())) {
+        if (part->getType() == "varDec") {
+            vector<ParseTree*> dec = childrenOf(part);
+            for (size_t i = 2; i < dec.size(); i += 2) {
+                define(dec[i]->getValue(), dec[1]->getValue(), LOCAL);
+            }
+        } else if (part->getType() == "statements") {
+            statements = part;
+        }
+    }
+
+    out += "function " + className + "." + name + " " + to_string(counts[LOCAL]) + "\n";
+    if (kind == "constructor") {
+        out += "push constant " + to_string(counts[FIELD]) + "\ncall Memory.alloc 1\npop pointer 0\n";
+    } else if (kind == "method") {
+        out += "push argument 0\npop pointer 0\n";
+    }
+    compileCode(statements, out);
+}
+
+/**
+ * Translate statements or an expression into VM code. Each tree is
+ * expanded into the lines and subtrees it translates to, which are pushed
+ * onto a stack in reverse so they come off in order.
+ * @param root The tree to translate
+ * @param out The VM code to append to
+ */
+void CodeGenerator::compileCode(ParseTree* root, string& out) {
+    vector<Work> stack;
+    vector<Work> items;
+    stack.push_back(Work{root, ""});
+    while (!stack.empty()) {
+        Work work = stack.back();
+        stack.pop_back();
+        if (work.node == NULL) {
+            out += work.line;
+            out += '\n';
+            continue;
+        }
+        items.clear();
+        expand(work.node, items);
+        stack.insert(stack.end(), items.rbegin(), items.rend());
+    }
+}
+
+/**
+ * Expand a statement or expression tree into the lines and subtrees it
+ * translates to
+ * @param node The tree
+ * @param items The list to append to, in output order
+ */
+void CodeGenerator::expand(ParseTree* node, vector<Work>& items) {
+    string type = node->getType();
+    vector<ParseTree*> children = childrenOf(node);
+
+    if (type == "statements") {
+        for (ParseTree* statement : children) {
+            items.push_back(Work{statement, ""});
+        }
+    } else if (type == "letStatement") {
+        string name = children[1]->getValue();
+        const Symbol* symbol = lookup(name);
+        if (symbol == NULL) {
+            throw CodeGenException(className + ": " + name + " is not declared");
+        }
+        string variable = segment(symbol->kind) + " " + to_string(symbol->index);
+        if (children[2]->getValue() == "[") {
+            items.push_back(Work{NULL, "push " + variable});
+            items.push_back(Work{children[3], ""});
+            items.push_back(Work{NULL, "add"});
+            items.push_back(Work{children[6], ""});
+            items.push_back(Work{NULL, "pop temp 0"});
+            items.push_back(Work{NULL, "pop pointer 1"});
+            items.push_back(Work{NULL, "push temp 0"});
+            items.push_back(Work{NULL, "pop that 0"});
+        } else {
+            items.push_back(Work{children[3], ""});
+            items.push_back(Work{NULL, "pop " + variable});
+        }
+    } else if (type == "ifStatement") {
+        string n = to_string(labelCount++);
+        items.push_back(Work{children[2], ""});
+        items.push_back(Work{NULL, "not"});
+        items.push_back(Work{NULL, "if-goto IF_FALSE" + n});
+        items.push_back(Work{children[5], ""});
+        if (children.size() > 7) {
+            items.push_back(Work{NULL, "goto IF_END" + n});
+            items.push_back(Work{NULL, "label IF_FALSE" + n});
+            items.push_back(Work{children[9], ""});
+            items.push_back(Work{NULL, "label IF_END" + n});
+        } else {
+            items.push_back(Work{NULL, "label IF_FALSE" + n});
+        }
+    } else if (type == "whileStatement") {
+        string n = to_string(labelCount++);
+        items.push_back(Work{NULL, "label WHILE_EXP" + n});
+        items.push_back(Work{children[2], ""});
+        items.push_back(Work{NULL, "not"});
+        items.push_back(Work{NULL, "if-goto WHILE_END" + n});
+        items.push_back(Work{children[5], ""});
+        items.push_back(Work{NULL, "goto WHILE_EXP" + n});
+        items.push_back(Work{NULL, "label WHILE_END" + n});
+    } else if (type == "doStatement") {
+        items.push_back(Work{children[1], ""});
+        items.push_back(Work{NULL, "pop temp 0"});
+    } else if (type == "returnStatement") {
+        if (children.size() > 2) {
+            items.push_back(Work{children[1], ""});
+        } else {
+            items.push_back(Work{NULL, "push constant 0"});
+        }
+        items.push_back(Work{NULL, "return"});
+    } else if (type == "expression") {
+        if (children.empty()) {
+            throw CodeGenException(className + ": empty expression");
+        }
+        if (children[0]->getValue() == "skip") {
+            items.push_back(Work{NULL, "push constant 0"});
+            return;
+        }
+        items.push_back(Work{children[0], ""});
+        for (size_t i = 1; i + 1 < children.size(); i += 2) {
+            items.push_back(Work{children[i + 1], ""});
+            switch (children[i]->getValue()[0]) {
+                case '+': items.push_back(Work{NULL, "add"}); break;
+                case '-': items.push_back(Work{NULL, "sub"}); break;
+                case '*': items.push_back(Work{NULL, "call Math.multiply 2"}); break;
+                case '/': items.push_back(Work{NULL, "call Math.divide 2"}); break;
+                case '&': items.push_back(Work{NULL, "and"}); break;
+                case '|': items.push_back(Work{NULL, "or"}); break;
+                case '<': items.push_back(Work{NULL, "lt"}); break;
+                case '>': items.push_back(Work{NULL, "gt"}); break;
+                default: items.push_back(Work{NULL, "eq"}); break;
+            }
+        }
+    } else if (type == "term") {
+        expandTerm(node, items);
+    } else {
+        throw CodeGenException(className + ": cannot translate " + type);
+    }
+}
+
+/**
+ * Expand a term into the lines and subtrees it translates to
+ * @param term The term
+ * @param items The list to append to, in output order
+ */
+void CodeGenerator::expandTerm(ParseTree* term, vector<Work>& items) {
+    vector<ParseTree*> children = childrenOf(term);
+    string type = children[0]->getType();
+    string value = children[0]->getValue();
+
+    if (type == "integerConstant") {
+        if (value.size() > 5 || atoi(value.c_str()) > 32767) {
+            throw CodeGenException(className + ": " + value + " is too large");
+        }
+        items.push_back(Work{NULL, "push constant " + value});
+    } else if (type == "stringConstant") {
+        items.push_back(Work{NULL, "push constant " + to_string(value.size())});
+        items.push_back(Work{NULL, "call String.new 1"});
+        for (unsigned char c : value) {
+            items.push_back(Work{NULL, "push constant " + to_string(c)});
+            items.push_back(Work{NULL, "call String.appendChar 2"});
+        }
+    } else if (type == "keyword") {
+        if (value == "true") {
+            items.push_back(Work{NULL, "push constant 0"});
+            items.push_back(Work{NULL, "not"});
+        } else if (value == "this") {
+            items.push_back(Work{NULL, "push pointer 0"});
+        } else {
+            items.push_back(Work{NULL, "push constant 0"});
+        }
+    } else if (value == "(") {
+        items.push_back(Work{children[1], ""});
+    } else if (value == "-" || value == "~") {
+        items.push_back(Work{children[1], ""});
+        items.push_back(Work{NULL, value == "-" ? "neg" : "not"});
+    } else if (children.size() > 1 && (children[1]->getValue() == "(" || children[1]->getValue() == ".")) {
+        expandCall(children, items);
+    } else {
+        const Symbol* symbol = lookup(value);
+        if (symbol == NULL) {
+            throw CodeGenException(className + ": " + value + " is not declared");
+        }
+        items.push_back(Work{NULL, "push " + segment(symbol->kind) + " " + to_string(symbol->index)});
+        if (children.size() > 1) {
+            items.push_back(Work{children[2], ""});
+            items.push_back(Work{NULL, "add"});
+            items.push_back(Work{NULL, "pop pointer 1"});
+            items.push_back(Work{NULL, "push that 0"});
+        }
+    }
+}
+
+/**
+ * Expand a subroutine call term: f(a) calls a method on this, v.m(a) a
+ * method on the object in v, and C.m(a) a function or constructor of C
+ * @param children The term's children
+ * @param items The list to append to, in output order
+ */
+void CodeGenerator::expandCall(vector<ParseTree*>& children, vector<Work>& items) {
+    string name = children[0]->getValue();
+    string target;
+    ParseTree* arguments;
+    int count = 0;
+    if (children[1]->getValue() == "(") {
+        items.push_back(Work{NULL, "push pointer 0"});
+        target = className + "." + name;
+        arguments = children[2];
+        count++;
+    } else {
+        const Symbol* symbol = lookup(name);
+        if (symbol != NULL) {
+            items.push_back(Work{NULL, "push " + segment(symbol->kind) + " " + to_string(symbol->index)});
+            target = symbol->type + "." + children[2]->getValue();
+            count++;
+        } else {
+            target = name + "." + children[2]->getValue();
+        }
+        arguments = children[4];
+    }
+    for (ParseTree::iterator it = arguments->childBegin(); it != arguments->childEnd(); it++) {
+        if ((*it)->getType() == "expression") {
+            items.push_back(Work{*it, ""});
+            count++;
+        }
+    }
+    items.push_back(Work{NULL, "call " + target + " " + to_string(count)});
+}
+
+/**
+ * Constructor for a CodeGenException
+ * @param message What could not be translated
+ */
+CodeGenException::CodeGenException(string message) {
+    CodeGenException::message = message;
+}
+
+/**
+ * Definition of a CodeGenException
+ * Thrown when a parse tree cannot be translated into VM code.
+ */
+const char* CodeGenException::what() const noexcept {
+    return message.c_str();
+}
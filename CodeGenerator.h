@@ -0,0 +1,65 @@
+#ifndef CODEGENERATOR_H
+#define CODEGENERATOR_H
+
+#include <exception>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ParseTree.h"
+
+/**
+ * Translates class parse trees from the CompilerParser into Hack VM code,
+ * following the standard Jack calling and object conventions so the output
+ * runs on the VirtualMachine or any other Hack VM. Statements and
+ * expressions are translated with an explicit work stack, so deeply nested
+ * trees do not exhaust the native stack.
+ */
+class CodeGenerator {
+    private:
+        enum Kind { STATIC, FIELD, ARGUMENT, LOCAL };
+
+        struct Symbol {
+            std::string type;
+            Kind kind;
+            int index;
+        };
+
+        /** A tree still to be translated, or a line ready to be written */
+        struct Work {
+            ParseTree* node;
+            std::string line;
+        };
+
+        std::string className;
+        std::map<std::string, Symbol> classScope;
+        std::map<std::string, Symbol> subroutineScope;
+        int counts[4];
+        int labelCount;
+
+        void define(const std::string& name, const std::string& type, Kind kind);
+        const Symbol* lookup(const std::string& name);
+        static std::string segment(Kind kind);
+
+        void compileSubroutine(ParseTree* subroutine, std::string& out);
+        void compileCode(ParseTree* root, std::string& out);
+        void expand(ParseTree* node, std::vector<Work>& items);
+        void expandTerm(ParseTree* term, std::vector<Work>& items);
+        void expandCall(std::vector<ParseTree*>& children, std::vector<Work>& items);
+
+    public:
+        CodeGenerator();
+
+        std::string compileClass(ParseTree* tree);
+};
+
+class CodeGenException : public std::exception {
+    private:
+        std::string message;
+
+    public:
+        CodeGenException(std::string message);
+        const char* what() const noexcept;
+};
+
+#endif /*CODEGENERATOR_H*/
@@ -1,6 +1,7 @@
 #include "CompilerParser.h"
 #include <iostream>
 #include <iterator>
+#include <stdexcept>
 #include <vector>
 #include <cstring>
 
@@ -11,6 +12,150 @@
 CompilerParser::CompilerParser(std::list<Token*> tokens){
     tkns = tokens;
     currentTokenIndex=0;
+    cursor = tkns.begin();
+    fill = tkns.begin();
+    windowStart=0;
+    windowCount=0;
+    iterative=false;
+    index=NULL;
+    source=NULL;
+    chunkSize=0;
+    ownsTokens=false;
+}
+
+/**
+ * Destructor for the CompilerParser. Tokens read from a source are deleted;
+ * tokens passed to the constructor belong to the caller.
+ */
+CompilerParser::~CompilerParser(){
+    if(ownsTokens){
+        for(Token* token : tkns){
+            delete token;
+        }
+    }
+}
+
+/**
+ * Choose how statements and expressions are parsed. In iterative mode the
+ * statement and expression grammar runs on an explicit heap-allocated stack
+ * instead of the native call stack, so input of any nesting depth can be
+ * parsed. Both modes produce the same trees.
+ * @param iterative true to parse iteratively, false to parse recursively
+ */
+void CompilerParser::setIterative(bool iterative){
+    CompilerParser::iterative = iterative;
+}
+
+/**
+ * Record every node the parser builds in an index, as it is built. The
+ * index does not follow nodes deleted later, so it should not be used after
+ * a failed parse or with compileClass(std::ostream&), which deletes each
+ * member once it is written.
+ * @param index The index to add nodes to, or NULL for none
+ */
+void CompilerParser::setIndex(TreeIndex* index){
+    CompilerParser::index = index;
+}
+
+/**
+ * Read source text to tokenize as the parser needs more tokens, rather than
+ * tokenizing it all up front. The parser owns the tokens it reads, and
+ * compileClass(std::ostream&) frees them as each member is written, so
+ * only the tokens of the member being parsed are held at once.
+ * @param in The stream to read; it must outlive the parser
+ * @param chunkSize The number of bytes read at a time
+ */
+void CompilerParser::setSource(std::istream* in, std::size_t chunkSize){
+    CompilerParser::source = in;
+    CompilerParser::chunkSize = chunkSize;
+    ownsTokens = true;
+}
+
+/**
+ * Tokenize more of the source, adding the tokens to the end of the list
+ * @return true if any tokens were added, false if the source is used up
+ */
+bool CompilerParser::readMore(){
+    std::list<Token*> more;
+    std::string chunk(chunkSize, '\0');
+    while(more.empty() && source != NULL){
+        source->read(&chunk[0], chunkSize);
+        std::streamsize count = source->gcount();
+        if(count > 0){
+            tokenizer.feed(chunk.substr(0, count), more);
+        }else{
+            tokenizer.finish(more);
+            source = NULL;
+        }
+    }
+    if(more.empty()){
+        return false;
+    }
+    bool empty = cursor == tkns.end();
+    std::list<Token*>::iterator first = more.begin();
+    tkns.splice(tkns.end(), more);
+    fill = first;
+    if(empty){
+        cursor = first;
+    }
+    return true;
+}
+
+/**
+ * Delete the tokens before the current one, if they were read from a
+ * source. Positions saved before them can no longer be restored.
+ */
+void CompilerParser::releaseConsumed(){
+    if(!ownsTokens){
+        return;
+    }
+    while(tkns.begin() != cursor){
+        delete tkns.front();
+        tkns.pop_front();
+    }
+}
+
+/**
+ * Creates a parse tree node, adding it to the index if there is one
+ * @param type The type of node
+ * @param value The node's value
+ * @return a ParseTree
+ */
+ParseTree* CompilerParser::node(std::string type, std::string value){
+    ParseTree* pt = new ParseTree(type, value);
+    if(index != NULL){
+        index->add(pt);
+    }
+    return pt;
+}
+
+/**
+ * Tokenize and parse the source of one class file. The tokens are freed
+ * before returning, whether or not the parse succeeds.
+ * @param source The Jack source text
+ * @param iterative true to parse in iterative mode, see setIterative()
+ * @param index The index to add nodes to as they are built, see setIndex(), or NULL for none
+ * @return The class's parse tree; a ParseException is thrown if the source
+ *         cannot be tokenized or parsed
+ */
+ParseTree* CompilerParser::parseClass(const std::string& source, bool iterative, TreeIndex* index){
+    std::list<Token*> tokens = Tokenizer::tokenize(source);
+    ParseTree* tree = NULL;
+    try{
+        CompilerParser parser(tokens);
+        parser.setIterative(iterative);
+        parser.setIndex(index);
+        tree = parser.compileClass();
+    }catch(...){
+        for(Token* token : tokens){
+            delete token;
+        }
+        throw;
+    }
+    for(Token* token : tokens){
+        delete token;
+    }
+    return tree;
 }
 
 /**
@@ -21,23 +166,23 @@ ParseTree* CompilerParser::compileProgram() {
     Token* t = mustBe("keyword", "class");
     std::string type = t->getType();
     std::string value = t->getValue();
-    ParseTree* pt = new ParseTree("class", "");
-    pt->addChild(new ParseTree(type, value));
+    ParseTree* pt = node("class", "");
+    pt->addChild(node(type, value));
 
     t = mustBe("identifier", "Main");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     t = mustBe("symbol", "{");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     t = mustBe("symbol", "}");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     return pt;
 }
@@ -50,18 +195,18 @@ ParseTree* CompilerParser::compileClass() {
     Token* t = mustBe("keyword", "class");
     std::string type = t->getType();
     std::string value = t->getValue();
-    ParseTree* pt = new ParseTree("class", "");
-    pt->addChild(new ParseTree(type, value));
+    ParseTree* pt = node("class", "");
+    pt->addChild(node(type, value));
 
-    t = mustBe("identifier", identifier(current()->getValue()));
+    t = mustBe("identifier", identifier(currentValue()));
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     t = mustBe("symbol", "{");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     while(have("keyword", "static") || have("keyword", "field")){
         pt->addChild(compileClassVarDec());
@@ -73,7 +218,62 @@ ParseTree* CompilerParser::compileClass() {
     t = mustBe("symbol", "}");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
+
+    return pt;
+}
+
+/**
+ * Generates a parse tree for a single class, writing it to a stream as it is
+ * parsed. Each classVarDec and Subroutine subtree is written as soon as it is
+ * complete and then freed, so only the largest member is ever held in memory.
+ * The text written is identical to compileClass()->tostring(). If parsing
+ * fails, the members written so far remain in the stream. With a source
+ * (see setSource()), the tokens of each member are freed with it.
+ * @param out The stream to write the class to
+ * @return a ParseTree holding only the class header and closing brace
+ */
+ParseTree* CompilerParser::compileClass(std::ostream& out) {
+    Token* t = mustBe("keyword", "class");
+    std::string type = t->getType();
+    std::string value = t->getValue();
+    ParseTree* pt = node("class", "");
+    pt->addChild(node(type, value));
+    out << "class\n";
+    out << "  \u2514 " << type << " " << value << "\n";
+
+    t = mustBe("identifier", identifier(currentValue()));
+    type = t->getType();
+    value = t->getValue();
+    pt->addChild(node(type, value));
+    out << "  \u2514 " << type << " " << value << "\n";
+
+    t = mustBe("symbol", "{");
+    type = t->getType();
+    value = t->getValue();
+    pt->addChild(node(type, value));
+    out << "  \u2514 " << type << " " << value << "\n";
+
+    ParseTree* member = NULL;
+    while(have("keyword", "static") || have("keyword", "field")){
+        member = compileClassVarDec();
+        out << "  \u2514 " << member->tostring(1);
+        delete member;
+        releaseConsumed();
+    }
+    while(have("keyword", "constructor") || have("keyword", "function") || have("keyword", "method")){
+        member = compileSubroutine();
+        out << "  \u2514 " << member->tostring(1);
+        delete member;
+        releaseConsumed();
+    }
+
+    t = mustBe("symbol", "}");
+    type = t->getType();
+    value = t->getValue();
+    pt->addChild(node(type, value));
+    out << "  \u2514 " << type << " " << value << "\n";
+    out << "\n";
 
     return pt;
 }
@@ -95,8 +295,8 @@ ParseTree* CompilerParser::compileClassVarDec() {
 
     std::string type = t->getType();
     std::string value = t->getValue();
-    ParseTree* pt = new ParseTree("classVarDec", "");
-    pt->addChild(new ParseTree(type, value));
+    ParseTree* pt = node("classVarDec", "");
+    pt->addChild(node(type, value));
 
     if(have("keyword", "int")){
         t = mustBe("keyword", "int");
@@ -107,37 +307,37 @@ ParseTree* CompilerParser::compileClassVarDec() {
     else if(have("keyword", "boolean")){
         t = mustBe("keyword", "boolean");
     }
-    else if(have("identifier", identifier(current()->getValue()))){
-        t = mustBe("identifier", current()->getValue());
+    else if(have("identifier", identifier(currentValue()))){
+        t = mustBe("identifier", currentValue());
     }else{
         throw ParseException();
     }
 
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
-    t = mustBe("identifier", identifier(current()->getValue()));
+    t = mustBe("identifier", identifier(currentValue()));
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     while(have("symbol", ",")){
         t = mustBe("symbol", ",");
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
 
-        t = mustBe("identifier", identifier(current()->getValue()));
+        t = mustBe("identifier", identifier(currentValue()));
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
     }
 
     t = mustBe("symbol", ";");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     return pt;
 
@@ -162,8 +362,8 @@ ParseTree* CompilerParser::compileSubroutine() {
     }
     std::string type = t->getType();
     std::string value = t->getValue();
-    ParseTree* pt = new ParseTree("Subroutine", "");
-    pt->addChild(new ParseTree(type, value));
+    ParseTree* pt = node("Subroutine", "");
+    pt->addChild(node(type, value));
 
     if(have("keyword", "void")){
         t = mustBe("keyword", "void");
@@ -177,24 +377,24 @@ ParseTree* CompilerParser::compileSubroutine() {
     else if(have("keyword", "boolean")){
         t = mustBe("keyword", "boolean");
     }
-    else if(have("identifier", identifier(current()->getValue()))){
-        t = mustBe("identifier", current()->getValue());
+    else if(have("identifier", identifier(currentValue()))){
+        t = mustBe("identifier", currentValue());
     }else{
         throw ParseException();
     }
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
-    t = mustBe("identifier", identifier(current()->getValue()));
+    t = mustBe("identifier", identifier(currentValue()));
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     t = mustBe("symbol", "(");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     if(!have("symbol", ")")){
         pt->addChild(compileParameterList());
@@ -204,7 +404,7 @@ ParseTree* CompilerParser::compileSubroutine() {
     t = mustBe("symbol", ")");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
 
     pt->addChild(compileSubroutineBody());
@@ -223,7 +423,7 @@ ParseTree* CompilerParser::compileParameterList() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("parameterList", "");
+    ParseTree* pt = node("parameterList", "");
     
     if(have("keyword", "int")){
         t = mustBe("keyword", "int");
@@ -234,25 +434,25 @@ ParseTree* CompilerParser::compileParameterList() {
     else if(have("keyword", "boolean")){
         t = mustBe("keyword", "boolean");
     }
-    else if(have("identifier", identifier(current()->getValue()))){
-        t = mustBe("identifier", current()->getValue());
+    else if(have("identifier", identifier(currentValue()))){
+        t = mustBe("identifier", currentValue());
     }else{
         throw ParseException();
     }
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
-    t = mustBe("identifier", identifier(current()->getValue()));
+    t = mustBe("identifier", identifier(currentValue()));
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     while(have("symbol", ",")){
         t = mustBe("symbol", ",");
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
 
         if(have("keyword", "int")){
         t = mustBe("keyword", "int");
@@ -263,20 +463,20 @@ ParseTree* CompilerParser::compileParameterList() {
         else if(have("keyword", "boolean")){
             t = mustBe("keyword", "boolean");
         }
-        else if(have("identifier", identifier(current()->getValue()))){
-            t = mustBe("identifier", current()->getValue());
+        else if(have("identifier", identifier(currentValue()))){
+            t = mustBe("identifier", currentValue());
         }else{
             throw ParseException();
         }
         
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
 
-        t = mustBe("identifier", identifier(current()->getValue()));
+        t = mustBe("identifier", identifier(currentValue()));
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
     }
 
     return pt;
@@ -291,12 +491,12 @@ ParseTree* CompilerParser::compileSubroutineBody() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("subroutineBody", "");
+    ParseTree* pt = node("subroutineBody", "");
 
     t = mustBe("symbol", "{");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     while(have("keyword", "var")){
         pt->addChild(compileVarDec());
@@ -307,7 +507,7 @@ ParseTree* CompilerParser::compileSubroutineBody() {
     t = mustBe("symbol", "}");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     return pt;
     return NULL;
@@ -322,12 +522,12 @@ ParseTree* CompilerParser::compileVarDec() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("varDec", "");
+    ParseTree* pt = node("varDec", "");
 
     t = mustBe("keyword", "var");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     if(have("keyword", "int")){
         t = mustBe("keyword", "int");
@@ -338,37 +538,37 @@ ParseTree* CompilerParser::compileVarDec() {
     else if(have("keyword", "boolean")){
         t = mustBe("keyword", "boolean");
     }
-    else if(have("identifier", identifier(current()->getValue()))){
-        t = mustBe("identifier", current()->getValue());
+    else if(have("identifier", identifier(currentValue()))){
+        t = mustBe("identifier", currentValue());
     }else{
         throw ParseException();
     }
 
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
-    t = mustBe("identifier", identifier(current()->getValue()));
+    t = mustBe("identifier", identifier(currentValue()));
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     while(have("symbol", ",")){
         t = mustBe("symbol", ",");
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
 
-        t = mustBe("identifier", identifier(current()->getValue()));
+        t = mustBe("identifier", identifier(currentValue()));
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
     }
 
     t = mustBe("symbol", ";");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     return pt;
 }
@@ -382,7 +582,11 @@ ParseTree* CompilerParser::compileStatements() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("statements", "");
+    if(iterative){
+        return compileIteratively(STATEMENTS);
+    }
+
+    ParseTree* pt = node("statements", "");
 
     while(have("keyword", "let") || have("keyword", "if") || have("keyword", "while") || have("keyword", "do") || have("keyword", "return")){
         if(have("keyword", "let")){
@@ -417,43 +621,43 @@ ParseTree* CompilerParser::compileLet() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("letStatement", "");
+    ParseTree* pt = node("letStatement", "");
 
     t = mustBe("keyword", "let");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
-    t = mustBe("identifier", identifier(current()->getValue()));
+    t = mustBe("identifier", identifier(currentValue()));
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     if(have("symbol", "[")){
         t = mustBe("symbol", "[");
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
 
         pt->addChild(compileExpression());
 
         t = mustBe("symbol", "]");
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
     }
 
     t = mustBe("symbol", "=");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     pt->addChild(compileExpression());
 
     t = mustBe("symbol", ";");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     return pt;
 }
@@ -467,54 +671,54 @@ ParseTree* CompilerParser::compileIf() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("ifStatement", "");
+    ParseTree* pt = node("ifStatement", "");
 
     t = mustBe("keyword", "if");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     t = mustBe("symbol", "(");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     pt->addChild(compileExpression());
 
     t = mustBe("symbol", ")");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     t = mustBe("symbol", "{");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     pt->addChild(compileStatements());
 
     t = mustBe("symbol", "}");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     if(have("keyword", "else")){
         t = mustBe("keyword", "else");
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
 
         t = mustBe("symbol", "{");
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
 
         pt->addChild(compileStatements());
 
         t = mustBe("symbol", "}");
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
     }
 
     return pt;
@@ -529,36 +733,36 @@ ParseTree* CompilerParser::compileWhile() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("whileStatement", "");
+    ParseTree* pt = node("whileStatement", "");
 
     t = mustBe("keyword", "while");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     t = mustBe("symbol", "(");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     pt->addChild(compileExpression());
 
     t = mustBe("symbol", ")");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     t = mustBe("symbol", "{");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     pt->addChild(compileStatements());
 
     t = mustBe("symbol", "}");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     return pt;
 }
@@ -572,19 +776,19 @@ ParseTree* CompilerParser::compileDo() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("doStatement", "");
+    ParseTree* pt = node("doStatement", "");
 
     t = mustBe("keyword", "do");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     pt->addChild(compileExpression());
 
     t = mustBe("symbol", ";");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     return pt;
 }
@@ -598,12 +802,12 @@ ParseTree* CompilerParser::compileReturn() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("returnStatement", "");
+    ParseTree* pt = node("returnStatement", "");
 
     t = mustBe("keyword", "return");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     if(!have("symbol", ";")){
         pt->addChild(compileExpression());
@@ -612,7 +816,7 @@ ParseTree* CompilerParser::compileReturn() {
     t = mustBe("symbol", ";");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
+    pt->addChild(node(type, value));
 
     return pt;
 }
@@ -626,15 +830,28 @@ ParseTree* CompilerParser::compileExpression() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("expression", "");
+    if(iterative){
+        return compileIteratively(EXPRESSION);
+    }
+
+    ParseTree* pt = node("expression", "");
 
     if(have("keyword", "skip")){
     t = mustBe("keyword", "skip");
     type = t->getType();
     value = t->getValue();
-    pt->addChild(new ParseTree(type, value));
-    }else if(have("integerConstant", current()->getValue())) {
+    pt->addChild(node(type, value));
+    }else if(haveTerm()) {
         pt->addChild(compileTerm());
+
+        while(haveOp()){
+            t = mustBe("symbol", currentValue());
+            type = t->getType();
+            value = t->getValue();
+            pt->addChild(node(type, value));
+
+            pt->addChild(compileTerm());
+        }
     }
 
     return pt;
@@ -649,13 +866,97 @@ ParseTree* CompilerParser::compileTerm() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("term", "");
+    ParseTree* pt = node("term", "");
+
+    if(have("integerConstant", currentValue())){
+        t=mustBe("integerConstant", currentValue());
+        type = t->getType();
+        value = t->getValue();
+        pt->addChild(node(type, value));
+    }
+    else if(have("stringConstant", currentValue())){
+        t=mustBe("stringConstant", currentValue());
+        type = t->getType();
+        value = t->getValue();
+        pt->addChild(node(type, value));
+    }
+    else if(have("keyword", "true") || have("keyword", "false") || have("keyword", "null") || have("keyword", "this")){
+        t=mustBe("keyword", currentValue());
+        type = t->getType();
+        value = t->getValue();
+        pt->addChild(node(type, value));
+    }
+    else if(have("symbol", "(")){
+        t = mustBe("symbol", "(");
+        type = t->getType();
+        value = t->getValue();
+        pt->addChild(node(type, value));
+
+        pt->addChild(compileExpression());
 
-    if(have("integerConstant", current()->getValue())){
-        t=mustBe("integerConstant", current()->getValue());
+        t = mustBe("symbol", ")");
         type = t->getType();
         value = t->getValue();
-        pt->addChild(new ParseTree(type, value));
+        pt->addChild(node(type, value));
+    }
+    else if(have("symbol", "-") || have("symbol", "~")){
+        t = mustBe("symbol", currentValue());
+        type = t->getType();
+        value = t->getValue();
+        pt->addChild(node(type, value));
+
+        pt->addChild(compileTerm());
+    }
+    else if(have("identifier", identifier(currentValue()))){
+        // x, x[i], f(a) and C.m(a) are told apart by the token after the name
+        Token* ahead = peek(1);
+        std::string aheadValue = (ahead != NULL && ahead->getType() == "symbol") ? ahead->getValue() : "";
+
+        t = mustBe("identifier", currentValue());
+        type = t->getType();
+        value = t->getValue();
+        pt->addChild(node(type, value));
+
+        if(aheadValue == "["){
+            t = mustBe("symbol", "[");
+            type = t->getType();
+            value = t->getValue();
+            pt->addChild(node(type, value));
+
+            pt->addChild(compileExpression());
+
+            t = mustBe("symbol", "]");
+            type = t->getType();
+            value = t->getValue();
+            pt->addChild(node(type, value));
+        }
+        else if(aheadValue == "(" || aheadValue == "."){
+            if(aheadValue == "."){
+                t = mustBe("symbol", ".");
+                type = t->getType();
+                value = t->getValue();
+                pt->addChild(node(type, value));
+
+                t = mustBe("identifier", identifier(currentValue()));
+                type = t->getType();
+                value = t->getValue();
+                pt->addChild(node(type, value));
+            }
+
+            t = mustBe("symbol", "(");
+            type = t->getType();
+            value = t->getValue();
+            pt->addChild(node(type, value));
+
+            pt->addChild(compileExpressionList());
+
+            t = mustBe("symbol", ")");
+            type = t->getType();
+            value = t->getValue();
+            pt->addChild(node(type, value));
+        }
+    }else{
+        throw ParseException();
     }
 
     return pt;
@@ -670,7 +971,11 @@ ParseTree* CompilerParser::compileExpressionList() {
     std::string type;
     std::string value;
 
-    ParseTree* pt = new ParseTree("expressionList", "");
+    if(iterative){
+        return compileIteratively(EXPRESSION_LIST);
+    }
+
+    ParseTree* pt = node("expressionList", "");
 
     if(!have("symbol", ")")){
         pt->addChild(compileExpression());
@@ -678,7 +983,7 @@ ParseTree* CompilerParser::compileExpressionList() {
             t = mustBe("symbol", ",");
             type = t->getType();
             value = t->getValue();
-            pt->addChild(new ParseTree(type, value));
+            pt->addChild(node(type, value));
 
             pt->addChild(compileExpression());
         }
@@ -687,11 +992,296 @@ ParseTree* CompilerParser::compileExpressionList() {
 }
 
 /**
- * Advance to the next token
+ * Generates a parse tree for a statement or expression production without
+ * recursion. Each stack frame holds a partly built node and how far through
+ * its production the parser is; a nested production is parsed by pushing a
+ * frame, and its node is added to the parent's when the frame is popped.
+ * The trees match those built by compileStatements() and compileExpression().
+ * @param production The production to parse
+ * @return a ParseTree
+ */
+ParseTree* CompilerParser::compileIteratively(Production production) {
+    struct Frame {
+        Production production;
+        ParseTree* node;
+        int state;
+    };
+    static const char* NODE_TYPES[] = {
+        "statements", "letStatement", "ifStatement", "whileStatement",
+        "doStatement", "returnStatement", "expression", "term", "expressionList"
+    };
+
+    std::vector<Frame> stack;
+    ParseTree* result = NULL;
+    stack.push_back(Frame{production, node(NODE_TYPES[production], ""), 0});
+
+    try {
+        while(!stack.empty()){
+            Frame& f = stack.back();
+            ParseTree* pt = f.node;
+            Production nested = production;
+            bool push = false;
+            bool done = false;
+
+            switch(f.production){
+                case STATEMENTS:
+                    if(have("keyword", "let")){
+                        nested = LET;
+                    }else if(have("keyword", "if")){
+                        nested = IF;
+                    }else if(have("keyword", "while")){
+                        nested = WHILE;
+                    }else if(have("keyword", "do")){
+                        nested = DO;
+                    }else if(have("keyword", "return")){
+                        nested = RETURN;
+                    }else{
+                        done = true;
+                        break;
+                    }
+                    push = true;
+                    break;
+
+                case LET:
+                    if(f.state == 0){
+                        pt->addChild(terminal("keyword", "let"));
+                        pt->addChild(terminal("identifier", identifier(currentValue())));
+                        if(have("symbol", "[")){
+                            pt->addChild(terminal("symbol", "["));
+                            nested = EXPRESSION;
+                            push = true;
+                            f.state = 1;
+                        }else{
+                            f.state = 2;
+                        }
+                    }else if(f.state == 1){
+                        pt->addChild(terminal("symbol", "]"));
+                        f.state = 2;
+                    }else if(f.state == 2){
+                        pt->addChild(terminal("symbol", "="));
+                        nested = EXPRESSION;
+                        push = true;
+                        f.state = 3;
+                    }else{
+                        pt->addChild(terminal("symbol", ";"));
+                        done = true;
+                    }
+                    break;
+
+                case IF:
+                    if(f.state == 0){
+                        pt->addChild(terminal("keyword", "if"));
+                        pt->addChild(terminal("symbol", "("));
+                        nested = EXPRESSION;
+                        push = true;
+                        f.state = 1;
+                    }else if(f.state == 1){
+                        pt->addChild(terminal("symbol", ")"));
+                        pt->addChild(terminal("symbol", "{"));
+                        nested = STATEMENTS;
+                        push = true;
+                        f.state = 2;
+                    }else if(f.state == 2){
+                        pt->addChild(terminal("symbol", "}"));
+                        if(have("keyword", "else")){
+                            pt->addChild(terminal("keyword", "else"));
+                            pt->addChild(terminal("symbol", "{"));
+                            nested = STATEMENTS;
+                            push = true;
+                            f.state = 3;
+                        }else{
+                            done = true;
+                        }
+                    }else{
+                        pt->addChild(terminal("symbol", "}"));
+                        done = true;
+                    }
+                    break;
+
+                case WHILE:
+                    if(f.state == 0){
+                        pt->addChild(terminal("keyword", "while"));
+                        pt->addChild(terminal("symbol", "("));
+                        nested = EXPRESSION;
+                        push = true;
+                        f.state = 1;
+                    }else if(f.state == 1){
+                        pt->addChild(terminal("symbol", ")"));
+                        pt->addChild(terminal("symbol", "{"));
+                        nested = STATEMENTS;
+                        push = true;
+                        f.state = 2;
+                    }else{
+                        pt->addChild(terminal("symbol", "}"));
+                        done = true;
+                    }
+                    break;
+
+                case DO:
+                    if(f.state == 0){
+                        pt->addChild(terminal("keyword", "do"));
+                        nested = EXPRESSION;
+                        push = true;
+                        f.state = 1;
+                    }else{
+                        pt->addChild(terminal("symbol", ";"));
+                        done = true;
+                    }
+                    break;
+
+                case RETURN:
+                    if(f.state == 0){
+                        pt->addChild(terminal("keyword", "return"));
+                        if(!have("symbol", ";")){
+                            nested = EXPRESSION;
+                            push = true;
+                        }
+                        f.state = 1;
+                    }else{
+                        pt->addChild(terminal("symbol", ";"));
+                        done = true;
+                    }
+                    break;
+
+                case EXPRESSION:
+                    if(f.state == 0){
+                        if(have("keyword", "skip")){
+                            pt->addChild(terminal("keyword", "skip"));
+                            done = true;
+                        }else if(haveTerm()){
+                            nested = TERM;
+                            push = true;
+                            f.state = 1;
+                        }else{
+                            done = true;
+                        }
+                    }else if(haveOp()){
+                        pt->addChild(terminal("symbol", currentValue()));
+                        nested = TERM;
+                        push = true;
+                    }else{
+                        done = true;
+                    }
+                    break;
+
+                case TERM:
+                    if(f.state == 0){
+                        if(have("integerConstant", currentValue()) || have("stringConstant", currentValue())){
+                            pt->addChild(terminal(current()->getType(), currentValue()));
+                            done = true;
+                        }else if(have("keyword", "true") || have("keyword", "false") || have("keyword", "null") || have("keyword", "this")){
+                            pt->addChild(terminal("keyword", currentValue()));
+                            done = true;
+                        }else if(have("symbol", "(")){
+                            pt->addChild(terminal("symbol", "("));
+                            nested = EXPRESSION;
+                            push = true;
+                            f.state = 1;
+                        }else if(have("symbol", "-") || have("symbol", "~")){
+                            pt->addChild(terminal("symbol", currentValue()));
+                            nested = TERM;
+                            push = true;
+                            f.state = 2;
+                        }else if(have("identifier", identifier(currentValue()))){
+                            Token* ahead = peek(1);
+                            std::string aheadValue = (ahead != NULL && ahead->getType() == "symbol") ? ahead->getValue() : "";
+                            pt->addChild(terminal("identifier", currentValue()));
+                            if(aheadValue == "["){
+                                pt->addChild(terminal("symbol", "["));
+                                nested = EXPRESSION;
+                                push = true;
+                                f.state = 3;
+                            }else if(aheadValue == "(" || aheadValue == "."){
+                                if(aheadValue == "."){
+                                    pt->addChild(terminal("symbol", "."));
+                                    pt->addChild(terminal("identifier", identifier(currentValue())));
+                                }
+                                pt->addChild(terminal("symbol", "("));
+                                nested = EXPRESSION_LIST;
+                                push = true;
+                                f.state = 1;
+                            }else{
+                                done = true;
+                            }
+                        }else{
+                            throw ParseException();
+                        }
+                    }else if(f.state == 1){
+                        pt->addChild(terminal("symbol", ")"));
+                        done = true;
+                    }else if(f.state == 3){
+                        pt->addChild(terminal("symbol", "]"));
+                        done = true;
+                    }else{
+                        done = true;
+                    }
+                    break;
+
+                case EXPRESSION_LIST:
+                    if(f.state == 0){
+                        if(!have("symbol", ")")){
+                            nested = EXPRESSION;
+                            push = true;
+                        }else{
+                            done = true;
+                        }
+                        f.state = 1;
+                    }else if(have("symbol", ",")){
+                        pt->addChild(terminal("symbol", ","));
+                        nested = EXPRESSION;
+                        push = true;
+                    }else{
+                        done = true;
+                    }
+                    break;
+            }
+
+            if(push){
+                // f is invalidated once the stack grows
+                stack.push_back(Frame{nested, node(NODE_TYPES[nested], ""), 0});
+            }else if(done){
+                stack.pop_back();
+                if(stack.empty()){
+                    result = pt;
+                }else{
+                    stack.back().node->addChild(pt);
+                }
+            }
+        }
+    } catch (...) {
+        for (Frame& f : stack) {
+            delete f.node;
+        }
+        throw;
+    }
+
+    return result;
+}
+
+/**
+ * Check the current token against the expected type and value, advance,
+ * and return a new terminal node for it.
+ * @return a ParseTree
+ */
+ParseTree* CompilerParser::terminal(std::string expectedType, std::string expectedValue){
+    Token* t = mustBe(expectedType, expectedValue);
+    return node(t->getType(), t->getValue());
+}
+
+/**
+ * Advance to the next token. Advancing past the last token leaves no current
+ * token, so a parse that runs off the end of the input fails its next check.
  */
 void CompilerParser::next(){
-    if(currentTokenIndex < tkns.size()-1)
-    currentTokenIndex++;
+    // Reading ahead first keeps the cursor off the end of the list while
+    // the source still has tokens
+    peek(1);
+    if(peek(0) != NULL){
+        windowStart = (windowStart + 1) % LOOKAHEAD;
+        windowCount--;
+        cursor++;
+        currentTokenIndex++;
+    }
 
     return;
 }
@@ -701,10 +1291,58 @@ void CompilerParser::next(){
  * @return the Token
  */
 Token* CompilerParser::current(){
-    std::list<Token*>::iterator it = tkns.begin();
-    std::advance(it, currentTokenIndex);
+    return peek(0);
+}
+
+/**
+ * Get the value of the current token
+ * @return the value, or an empty string at the end of the input, which no
+ *         have(), mustBe() or identifier() check accepts
+ */
+std::string CompilerParser::currentValue(){
+    Token* t = current();
+    return t == NULL ? "" : t->getValue();
+}
+
+/**
+ * Look ahead of the current token without advancing. Upcoming tokens are
+ * kept in a small ring buffer, so each is read from the list only once.
+ * @param k How far to look ahead; 0 is the current token. Values outside
+ *          [0, LOOKAHEAD) throw std::out_of_range, as they would overrun the ring.
+ * @return the Token, or NULL if there are not that many tokens left
+ */
+Token* CompilerParser::peek(int k){
+    if(k < 0 || k >= LOOKAHEAD){
+        throw std::out_of_range("CompilerParser::peek: lookahead of " + std::to_string(k) + " is out of range");
+    }
+    while(windowCount <= k && (fill != tkns.end() || readMore())){
+        window[(windowStart + windowCount) % LOOKAHEAD] = *fill;
+        fill++;
+        windowCount++;
+    }
+    if(k >= windowCount){
+        return NULL;
+    }
+    return window[(windowStart + k) % LOOKAHEAD];
+}
+
+/**
+ * Save the current position so parsing can resume from it later
+ * @return the Position
+ */
+CompilerParser::Position CompilerParser::save(){
+    return Position{currentTokenIndex, cursor};
+}
 
-    return it.operator*();
+/**
+ * Return to a position returned by save()
+ * @param position The position to return to
+ */
+void CompilerParser::restore(Position position){
+    currentTokenIndex = position.index;
+    cursor = position.token;
+    fill = position.token;
+    windowCount = 0;
 }
 
 /**
@@ -713,7 +1351,7 @@ Token* CompilerParser::current(){
  */
 bool CompilerParser::have(std::string expectedType, std::string expectedValue){
     Token* t = current();
-    if(t->getType() == expectedType && t->getValue() == expectedValue){
+    if(t != NULL && t->getType() == expectedType && t->getValue() == expectedValue){
         return true;
     }
     return false;
@@ -727,7 +1365,7 @@ bool CompilerParser::have(std::string expectedType, std::string expectedValue){
 Token* CompilerParser::mustBe(std::string expectedType, std::string expectedValue){
     Token* t= current();
 
-    if(t->getType() == expectedType && t->getValue() == expectedValue){
+    if(t != NULL && t->getType() == expectedType && t->getValue() == expectedValue){
         next();
         return t;
     }else{
@@ -736,6 +1374,42 @@ Token* CompilerParser::mustBe(std::string expectedType, std::string expectedValu
     return NULL;
 }
 
+/**
+ * Check if the current token can start an expression term.
+ * @return true if a term follows, false otherwise
+ */
+bool CompilerParser::haveTerm(){
+    Token* t = current();
+    if(t == NULL){
+        return false;
+    }
+    std::string type = t->getType();
+    std::string value = t->getValue();
+    if(type == "integerConstant" || type == "stringConstant" || type == "identifier"){
+        return true;
+    }
+    if(type == "keyword"){
+        return value == "true" || value == "false" || value == "null" || value == "this";
+    }
+    if(type == "symbol"){
+        return value == "(" || value == "-" || value == "~";
+    }
+    return false;
+}
+
+/**
+ * Check if the current token is a binary operator.
+ * @return true if an operator, false otherwise
+ */
+bool CompilerParser::haveOp(){
+    Token* t = current();
+    if(t == NULL){
+        return false;
+    }
+    std::string value = t->getValue();
+    return t->getType() == "symbol" && value.size() == 1 && std::strchr("+-*/&|<>=", value[0]) != NULL;
+}
+
 std::string CompilerParser::identifier(std::string value){
     if(value[0]=='_'||isalpha(value[0])==0){
         throw ParseException();
@@ -1,21 +1,63 @@
 #ifndef COMPILERPARSER_H
 #define COMPILERPARSER_H
 
+#include <cstddef>
 #include <list>
 #include <exception>
+#include <istream>
+#include <ostream>
 
 #include "ParseTree.h"
 #include "Token.h"
+#include "Tokenizer.h"
+#include "TreeIndex.h"
 
 class CompilerParser {
     private:
+        static const int LOOKAHEAD = 4;
+
         std::list<Token*> tkns;
         int currentTokenIndex;
+        std::list<Token*>::iterator cursor;
+        std::list<Token*>::iterator fill;
+        Token* window[LOOKAHEAD];
+        int windowStart;
+        int windowCount;
+        bool iterative;
+        TreeIndex* index;
+        // Where more tokens come from once the list runs out; tokens read
+        // from it belong to the parser
+        std::istream* source;
+        Tokenizer tokenizer;
+        std::size_t chunkSize;
+        bool ownsTokens;
+
+        enum Production { STATEMENTS, LET, IF, WHILE, DO, RETURN, EXPRESSION, TERM, EXPRESSION_LIST };
+
+        ParseTree* compileIteratively(Production production);
+        ParseTree* terminal(std::string expectedType, std::string expectedValue);
+        ParseTree* node(std::string type, std::string value);
+        bool readMore();
+        void releaseConsumed();
     public:
+        /** A saved parser position, see save() and restore() */
+        struct Position {
+            int index;
+            std::list<Token*>::iterator token;
+        };
+
         CompilerParser(std::list<Token*> tokens);
+        ~CompilerParser();
+
+        void setIterative(bool iterative);
+        void setIndex(TreeIndex* index);
+        void setSource(std::istream* in, std::size_t chunkSize);
+
+        static ParseTree* parseClass(const std::string& source, bool iterative, TreeIndex* index);
 
         ParseTree* compileProgram();
         ParseTree* compileClass();
+        ParseTree* compileClass(std::ostream& out);
         ParseTree* compileClassVarDec();
         ParseTree* compileSubroutine();
         ParseTree* compileParameterList();
@@ -35,8 +77,14 @@ class CompilerParser {
         
         void next();
         Token* current();
+        std::string currentValue();
+        Token* peek(int k);
+        Position save();
+        void restore(Position position);
         bool have(std::string expectedType, std::string expectedValue);
         Token* mustBe(std::string expectedType, std::string expectedValue);
+        bool haveTerm();
+        bool haveOp();
         std::string identifier(std::string value);
 };
 
@@ -0,0 +1,379 @@
+#include "ConstantFolder.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Truncate a value to a signed 16-bit Jack integer
+ * @param value The value to wrap
+ * @return The wrapped value
+ */
+static int wrap(int value) {
+    return (int) (int16_t) (uint16_t) (value & 0xFFFF);
+}
+
+/**
+ * Constructor for the ConstantFolder
+ */
+ConstantFolder::ConstantFolder() {
+    foldedExpressions = 0;
+    removedBranches = 0;
+    removedLoops = 0;
+}
+
+/**
+ * Fold constants and remove dead branches in a parse tree, in place
+ * @param tree The tree to optimize
+ */
+void ConstantFolder::fold(ParseTree* tree) {
+    visit(tree);
+}
+
+/**
+ * Optimize every node after optimizing its children, so each node is
+ * visited once. Uses an explicit stack so trees of any depth can be folded.
+ * @param node The root of the tree to optimize
+ */
+void ConstantFolder::visit(ParseTree* node) {
+    struct Frame {
+        ParseTree* node;
+        ParseTree::iterator next;
+    };
+    vector<Frame> stack;
+    stack.push_back(Frame{node, node->childBegin()});
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        if (top.next != top.node->childEnd()) {
+            ParseTree* child = *top.next++;
+            stack.push_back(Frame{child, child->childBegin()});
+            continue;
+        }
+        ParseTree* current = top.node;
+        stack.pop_back();
+        string type = current->getType();
+        if (type == "term") {
+            foldTerm(current);
+        } else if (type == "expression") {
+            foldExpression(current);
+        } else if (type == "statements") {
+            foldStatements(current);
+        }
+    }
+}
+
+/**
+ * Replace a unary or parenthesized term of a constant with the constant itself
+ * @param term The term to fold; its children are already folded
+ */
+void ConstantFolder::foldTerm(ParseTree* term) {
+    ParseTree::iterator first = term->childBegin();
+    if (first == term->childEnd() || (*first)->getType() != "symbol") {
+        return;
+    }
+    string symbol = (*first)->getValue();
+    ParseTree::iterator second = first;
+    second++;
+
+    int value;
+    bool boolean;
+    if (symbol == "(") {
+        ParseTree* expression = *second;
+        ParseTree::iterator inner = expression->childBegin();
+        if (inner == expression->childEnd() || (*inner)->getType() != "term") {
+            return;
+        }
+        ParseTree::iterator rest = inner;
+        if (++rest != expression->childEnd() || !constantValue(*inner, value, boolean)) {
+            return;
+        }
+    } else if (symbol == "-" || symbol == "~") {
+        if (!constantValue(*second, value, boolean)) {
+            return;
+        }
+        if (symbol == "-") {
+            ParseTree::iterator inner = (*second)->childBegin();
+            if ((*inner)->getType() == "integerConstant") {
+                // Already the canonical form of a negative constant
+                return;
+            }
+            value = wrap(-value);
+            boolean = false;
+        } else {
+            value = wrap(~value);
+        }
+    } else {
+        return;
+    }
+
+    if (!representable(value, boolean)) {
+        return;
+    }
+    setConstant(term, value, boolean);
+    foldedExpressions++;
+    changes.push_back("folded term to " + to_string(value));
+}
+
+/**
+ * Fold the longest constant prefix of an expression into a single term.
+ * Jack evaluates operators left to right, so only a prefix can be folded.
+ * @param expression The expression to fold; its terms are already folded
+ */
+void ConstantFolder::foldExpression(ParseTree* expression) {
+    ParseTree::iterator it = expression->childBegin();
+    if (it == expression->childEnd() || (*it)->getType() != "term") {
+        return;
+    }
+    int value;
+    bool boolean;
+    if (!constantValue(*it, value, boolean)) {
+        return;
+    }
+    it++;
+
+    ParseTree::iterator foldedEnd = expression->childBegin();
+    int operations = 0;
+    while (it != expression->childEnd()) {
+        char op = (*it)->getValue()[0];
+        ParseTree::iterator right = it;
+        right++;
+        int rightValue;
+        bool rightBoolean;
+        int result;
+        if (right == expression->childEnd() || !constantValue(*right, rightValue, rightBoolean) || !applyOp(op, value, rightValue, result)) {
+            break;
+        }
+        bool resultBoolean = op == '<' || op == '>' || op == '=' || ((op == '&' || op == '|') && boolean && rightBoolean);
+        if (!representable(result, resultBoolean)) {
+            break;
+        }
+        value = result;
+        boolean = resultBoolean;
+        operations++;
+        it = ++right;
+        foldedEnd = it;
+    }
+    if (operations == 0) {
+        return;
+    }
+
+    while (expression->childBegin() != foldedEnd) {
+        expression->eraseChild(expression->childBegin());
+    }
+    ParseTree* term = new ParseTree("term", "");
+    setConstant(term, value, boolean);
+    expression->insertChild(foldedEnd, term);
+    foldedExpressions++;
+    changes.push_back("folded " + to_string(operations) + " operations to " + to_string(value));
+}
+
+/**
+ * Remove if statements and while loops with conditions that are constant
+ * true (-1) or false (0). The chosen branch of an if statement is spliced
+ * into its place.
+ * @param statements The statements to simplify; nested statements are already simplified
+ */
+void ConstantFolder::foldStatements(ParseTree* statements) {
+    ParseTree::iterator it = statements->childBegin();
+    while (it != statements->childEnd()) {
+        string type = (*it)->getType();
+        if (type != "ifStatement" && type != "whileStatement") {
+            it++;
+            continue;
+        }
+
+        list<ParseTree*> parts = (*it)->getChildren();
+        list<ParseTree*>::iterator part = parts.begin();
+        advance(part, 2);
+        ParseTree* condition = *part;
+        ParseTree::iterator term = condition->childBegin();
+        int value;
+        bool boolean;
+        if (term == condition->childEnd() || (*term)->getType() != "term" || !constantValue(*term, value, boolean)) {
+            it++;
+            continue;
+        }
+        ParseTree::iterator rest = term;
+        // Generated code takes a branch only on true (-1) and skips it only
+        // on false (0); any other value is left for the program to decide
+        if (++rest != condition->childEnd() || (value != -1 && value != 0)) {
+            it++;
+            continue;
+        }
+
+        if (type == "whileStatement") {
+            if (value != 0) {
+                it++;
+                continue;
+            }
+            it = statements->eraseChild(it);
+            removedLoops++;
+            changes.push_back("removed while loop with false condition");
+            continue;
+        }
+
+        // if ( expression ) { statements } [ else { statements } ]
+        advance(part, 3);
+        ParseTree* kept = NULL;
+        if (value == -1) {
+            kept = *part;
+        } else if (parts.size() > 7) {
+            advance(part, 4);
+            kept = *part;
+        }
+        if (kept != NULL) {
+            statements->spliceChildren(it, kept);
+        }
+        it = statements->eraseChild(it);
+        removedBranches++;
+        changes.push_back(value == -1 ? "removed else branch of if with true condition" : "removed then branch of if with false condition");
+    }
+}
+
+/**
+ * Get the value of a term in canonical constant form: an integer constant,
+ * true, false, or a negated integer constant
+ * @param term The term to check
+ * @param value Set to the term's value
+ * @param boolean Set to true if the term is true or false
+ * @return true if the term is a constant, false otherwise
+ */
+bool ConstantFolder::constantValue(ParseTree* term, int& value, bool& boolean) {
+    if (term->getType() != "term") {
+        return false;
+    }
+    ParseTree::iterator it = term->childBegin();
+    if (it == term->childEnd()) {
+        return false;
+    }
+    ParseTree* first = *it;
+    it++;
+    if (it == term->childEnd()) {
+        if (first->getType() == "integerConstant") {
+            long parsed = strtol(first->getValue().c_str(), NULL, 10);
+            if (parsed > 32767) {
+                return false;
+            }
+            value = (int) parsed;
+            boolean = false;
+            return true;
+        }
+        if (first->getType() == "keyword" && (first->getValue() == "true" || first->getValue() == "false")) {
+            value = first->getValue() == "true" ? -1 : 0;
+            boolean = true;
+            return true;
+        }
+        return false;
+    }
+    if (first->getType() == "symbol" && first->getValue() == "-") {
+        ParseTree* inner = *it;
+        ParseTree::iterator innerIt = inner->childBegin();
+        if (innerIt == inner->childEnd() || (*innerIt)->getType() != "integerConstant" || !constantValue(inner, value, boolean)) {
+            return false;
+        }
+        value = -value;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Apply a binary operator with 16-bit Jack semantics
+ * @param op The operator symbol
+ * @param left The left operand
+ * @param right The right operand
+ * @param result Set to the result
+ * @return true if the operation was applied, false if it cannot be folded
+ */
+bool ConstantFolder::applyOp(char op, int left, int right, int& result) {
+    switch (op) {
+        case '+': result = wrap(left + right); return true;
+        case '-': result = wrap(left - right); return true;
+        case '*': result = wrap(left * right); return true;
+        case '/':
+            if (right == 0) {
+                return false;
+            }
+            result = wrap(left / right);
+            return true;
+        case '&': result = wrap(left & right); return true;
+        case '|': result = wrap(left | right); return true;
+        case '<': result = left < right ? -1 : 0; return true;
+        case '>': result = left > right ? -1 : 0; return true;
+        case '=': result = left == right ? -1 : 0; return true;
+        default: return false;
+    }
+}
+
+/**
+ * Check if a value can be written as a constant term. Integer constants are
+ * 0 to 32767, so -32768 has no constant form.
+ * @return true if representable, false otherwise
+ */
+bool ConstantFolder::representable(int value, bool boolean) {
+    return (boolean && (value == 0 || value == -1)) || value > -32768;
+}
+
+/**
+ * Replace the children of a term with the canonical form of a constant
+ * @param term The term to rewrite
+ * @param value The constant's value
+ * @param boolean true to write true or false rather than an integer
+ */
+void ConstantFolder::setConstant(ParseTree* term, int value, bool boolean) {
+    while (term->childBegin() != term->childEnd()) {
+        term->eraseChild(term->childBegin());
+    }
+    if (boolean && (value == 0 || value == -1)) {
+        term->addChild(new ParseTree("keyword", value == 0 ? "false" : "true"));
+    } else if (value >= 0) {
+        term->addChild(new ParseTree("integerConstant", to_string(value)));
+    } else {
+        ParseTree* inner = new ParseTree("term", "");
+        inner->addChild(new ParseTree("integerConstant", to_string(-value)));
+        term->addChild(new ParseTree("symbol", "-"));
+        term->addChild(inner);
+    }
+}
+
+/**
+ * Get the number of expressions and terms folded
+ * @return The fold count
+ */
+int ConstantFolder::getFoldedExpressions() {
+    return foldedExpressions;
+}
+
+/**
+ * Get the number of if statements replaced by one of their branches
+ * @return The branch count
+ */
+int ConstantFolder::getRemovedBranches() {
+    return removedBranches;
+}
+
+/**
+ * Get the number of while loops removed
+ * @return The loop count
+ */
+int ConstantFolder::getRemovedLoops() {
+    return removedLoops;
+}
+
+/**
+ * Generate a report of what the pass changed
+ * @return A printable summary followed by one line per change
+ */
+string ConstantFolder::report() {
+    ostringstream out;
+    out << "constant folding: " << foldedExpressions << " folded, "
+        << removedBranches << " branches removed, "
+        << removedLoops << " loops removed\n";
+    for (string change : changes) {
+        out << "  " << change << "\n";
+    }
+    return out.str();
+}
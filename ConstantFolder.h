@@ -0,0 +1,43 @@
+#ifndef CONSTANTFOLDER_H
+#define CONSTANTFOLDER_H
+
+#include <list>
+#include <string>
+
+#include "ParseTree.h"
+
+/**
+ * Optimization pass over parse trees from the CompilerParser.
+ * Folds constant integer and comparison subexpressions with 16-bit Jack
+ * semantics, and removes if branches and while loops whose conditions are
+ * constant. Trees are rewritten in place in a single post-order walk.
+ */
+class ConstantFolder {
+    private:
+        int foldedExpressions;
+        int removedBranches;
+        int removedLoops;
+        std::list<std::string> changes;
+
+        void visit(ParseTree* node);
+        void foldTerm(ParseTree* term);
+        void foldExpression(ParseTree* expression);
+        void foldStatements(ParseTree* statements);
+
+        static bool constantValue(ParseTree* term, int& value, bool& boolean);
+        static bool applyOp(char op, int left, int right, int& result);
+        static bool representable(int value, bool boolean);
+        static void setConstant(ParseTree* term, int value, bool boolean);
+
+    public:
+        ConstantFolder();
+
+        void fold(ParseTree* tree);
+
+        int getFoldedExpressions();
+        int getRemovedBranches();
+        int getRemovedLoops();
+        std::string report();
+};
+
+#endif /*CONSTANTFOLDER_H*/
@@ -0,0 +1,531 @@
+#include "FileLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+using namespace std;
+
+#ifdef HAVE_IO_URING
+/**
+ * Minimal io_uring submission and completion rings, set up with the raw
+ * system calls so no library is needed.
+ */
+class IoUring {
+    private:
+        int ringFd;
+        void* sqRing;
+        void* cqRing;
+        size_t sqRingSize;
+        size_t cqRingSize;
+        io_uring_sqe* sqes;
+        size_t sqesSize;
+        unsigned* sqHead;
+        unsigned* sqTail;
+        unsigned* sqMask;
+        unsigned* sqArray;
+        unsigned* cqHead;
+        unsigned* cqTail;
+        unsigned* cqMask;
+        io_uring_cqe* cqes;
+        unsigned queued;
+
+    public:
+        IoUring() {
+            ringFd = -1;
+            sqRing = MAP_FAILED;
+            cqRing = MAP_FAILED;
+            sqes = (io_uring_sqe*) MAP_FAILED;
+            queued = 0;
+        }
+
+        ~IoUring() {
+            if (sqes != MAP_FAILED) {
+                munmap(sqes, sqesSize);
+            }
+            if (cqRing != MAP_FAILED && cqRing != sqRing) {
+                munmap(cqRing, cqRingSize);
+            }
+            if (sqRing != MAP_FAILED) {
+                munmap(sqRing, sqRingSize);
+            }
+            if (ringFd >= 0) {
+                close(ringFd);
+            }
+        }
+
+        /**
+         * Create the rings and check the kernel supports the operations used
+         * @param entries The number of submission queue entries
+         * @return true if the ring is ready, false if io_uring is unavailable
+         */
+        bool setup(unsigned entries) {
+            io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            ringFd = (int) syscall(__NR_io_uring_setup, entries, &params);
+            if (ringFd < 0) {
+                return false;
+            }
+
+            sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+            }
+            sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+            if (sqRing == MAP_FAILED) {
+                return false;
+            }
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                cqRing = sqRing;
+            } else {
+                cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+                if (cqRing == MAP_FAILED) {
+                    return false;
+                }
+            }
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = (io_uring_sqe*) mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED) {
+                return false;
+            }
+
+            char* sq = (char*) sqRing;
+            char* cq = (char*) cqRing;
+            sqHead = (unsigned*) (sq + params.sq_off.head);
+            sqTail = (unsigned*) (sq + params.sq_off.tail);
+            sqMask = (unsigned*) (sq + params.sq_off.ring_mask);
+            sqArray = (unsigned*) (sq + params.sq_off.array);
+            cqHead = (unsigned*) (cq + params.cq_off.head);
+            cqTail = (unsigned*) (cq + params.cq_off.tail);
+            cqMask = (unsigned*) (cq + params.cq_off.ring_mask);
+            cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+
+            // Opening files through the ring needs Linux 5.6 or later
+            size_t probeSize = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+            io_uring_probe* probe = (io_uring_probe*) calloc(1, probeSize);
+            bool supported = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, 256) == 0
+                && probe->last_op >= IORING_OP_READ
+                && (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+                && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+                && (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED);
+            free(probe);
+            return supported;
+        }
+
+        /**
+         * Get the next submission queue entry to fill in
+         * @return The entry, cleared
+         */
+        io_uring_sqe* nextSqe() {
+            unsigned tail = *sqTail + queued;
+            unsigned index = tail & *sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqArray[index] = index;
+            queued++;
+            return sqe;
+        }
+
+        /**
+         * Submit the queued entries and wait for at least one completion.
+         * The kernel may take fewer entries than it is offered, so entering
+         * is repeated until it has taken them all; an entry left in the ring
+         * would never complete, and waiting on it would hang.
+         * @return true on success, false if the kernel rejected the submission
+         */
+        bool submitAndWait() {
+            __atomic_store_n(sqTail, *sqTail + queued, __ATOMIC_RELEASE);
+            queued = 0;
+            while (true) {
+                unsigned toSubmit = unsubmitted();
+                long result = syscall(__NR_io_uring_enter, ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+                if (result < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (result < 0 || (result == 0 && toSubmit > 0)) {
+                    return false;
+                }
+                if (unsubmitted() == 0) {
+                    return true;
+                }
+            }
+        }
+
+        /**
+         * Wait for at least one completion without submitting anything
+         * @return true on success, false if the kernel rejected the wait
+         */
+        bool wait() {
+            while (true) {
+                long result = syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+                if (result >= 0) {
+                    return true;
+                }
+                if (errno != EINTR) {
+                    return false;
+                }
+            }
+        }
+
+        /**
+         * Count the entries made ready for the kernel that it has not taken
+         * @return The number of entries; after submitAndWait() succeeds, none
+         */
+        unsigned unsubmitted() {
+            return *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        }
+
+        /**
+         * Take the next completion, if there is one
+         * @param cqe Set to the completion
+         * @return true if a completion was taken, false if none are ready
+         */
+        bool popCqe(io_uring_cqe& cqe) {
+            unsigned head = *cqHead;
+            if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                return false;
+            }
+            cqe = cqes[head & *cqMask];
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+};
+#endif
+
+/**
+ * Constructor for the FileLoader
+ * @param batchSize The most files in flight at once through io_uring
+ * @param threads The number of threads for the pread fallback, or 0 for one per core
+ */
+FileLoader::FileLoader(int batchSize, int threads) {
+    FileLoader::batchSize = max(1, batchSize);
+    FileLoader::threads = threads;
+    useIoUring = true;
+    lastUsedIoUring = false;
+}
+
+/**
+ * Choose whether to try io_uring before falling back to threads
+ * @param useIoUring false to always use the thread pool
+ */
+void FileLoader::setUseIoUring(bool useIoUring) {
+    FileLoader::useIoUring = useIoUring;
+}
+
+/**
+ * Check which path the last call to load() took
+ * @return true if files were loaded through io_uring, false otherwise
+ */
+bool FileLoader::usedIoUring() {
+    return lastUsedIoUring;
+}
+
+/**
+ * Load a set of files, handing each to the callback as it completes
+ * @param files The files to load
+ * @param callback Called once for every file
+ */
+void FileLoader::load(const vector<string>& files, Callback callback) {
+    vector<size_t> remaining;
+    lastUsedIoUring = useIoUring && loadWithIoUring(files, callback, remaining);
+    if (!lastUsedIoUring) {
+        loadWithThreads(files, callback);
+    } else if (!remaining.empty()) {
+        vector<string> rest;
+        for (size_t i : remaining) {
+            rest.push_back(files[i]);
+        }
+        Callback restCallback = [&](size_t i, string& contents, bool ok) {
+            callback(remaining[i], contents, ok);
+        };
+        loadWithThreads(rest, restCallback);
+    }
+}
+
+/**
+ * Load a set of files and process each on a pool of worker threads as soon
+ * as it has been read, so reading later files overlaps processing earlier
+ * ones. At most batchSize loaded files wait for a worker; loading pauses
+ * while that many are waiting.
+ * @param files The files to load
+ * @param process Called once for every file, on one of threads workers (or
+ *                one per core). Unlike load()'s callback, calls may overlap,
+ *                and process must not throw.
+ */
+void FileLoader::loadAndProcess(const vector<string>& files, Callback process) {
+    struct Loaded {
+        size_t index;
+        string contents;
+        bool ok;
+    };
+
+    int count = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+    mutex readyLock;
+    condition_variable readyChanged;
+    deque<Loaded> ready;
+    bool loading = true;
+    vector<thread> workers;
+    for (int t = 0; t < count && t < (int) files.size(); t++) {
+        workers.push_back(thread([&]() {
+            while (true) {
+                Loaded file;
+                {
+                    unique_lock<mutex> guard(readyLock);
+                    readyChanged.wait(guard, [&]() {
+                        return !ready.empty() || !loading;
+                    });
+                    if (ready.empty()) {
+                        return;
+                    }
+                    file = std::move(ready.front());
+                    ready.pop_front();
+                }
+                readyChanged.notify_all();
+                process(file.index, file.contents, file.ok);
+            }
+        }));
+    }
+
+    load(files, [&](size_t i, string& contents, bool ok) {
+        {
+            unique_lock<mutex> guard(readyLock);
+            readyChanged.wait(guard, [&]() {
+                return ready.size() < (size_t) batchSize;
+            });
+            ready.push_back(Loaded{i, std::move(contents), ok});
+        }
+        readyChanged.notify_all();
+    });
+    {
+        lock_guard<mutex> guard(readyLock);
+        loading = false;
+    }
+    readyChanged.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Load files through io_uring. Each file moves through an open, one or more
+ * reads and a close; up to batchSize files are in flight, and a new file is
+ * opened whenever one finishes. If the kernel rejects a submission, the
+ * requests it already took are waited for and the files not yet handed to
+ * the callback are left to the caller.
+ * @param remaining Set to the indices of files the callback was not called for
+ * @return false, before calling the callback, if io_uring is unavailable
+ */
+bool FileLoader::loadWithIoUring(const vector<string>& files, Callback& callback, vector<size_t>& remaining) {
+#ifdef HAVE_IO_URING
+    enum Stage { OPENING, READING, CLOSING };
+    struct Slot {
+        size_t index;
+        int fd;
+        Stage stage;
+        bool ok;
+        size_t done;
+        string buffer;
+    };
+
+    unique_ptr<IoUring> owner(new IoUring());
+    IoUring& ring = *owner;
+    if (!ring.setup(batchSize)) {
+        return false;
+    }
+    if (files.empty()) {
+        return true;
+    }
+
+    vector<Slot> slots(batchSize);
+    vector<int> freeSlots;
+    for (int i = batchSize - 1; i >= 0; i--) {
+        freeSlots.push_back(i);
+    }
+    size_t nextFile = 0;
+    size_t finished = 0;
+    while (finished < files.size()) {
+        while (!freeSlots.empty() && nextFile < files.size()) {
+            int s = freeSlots.back();
+            freeSlots.pop_back();
+            Slot& slot = slots[s];
+            slot.index = nextFile++;
+            slot.fd = -1;
+            slot.stage = OPENING;
+            slot.ok = false;
+            slot.done = 0;
+            slot.buffer.clear();
+            io_uring_sqe* sqe = ring.nextSqe();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long) files[slot.index].c_str();
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data = s;
+        }
+        if (!ring.submitAndWait()) {
+            // Requests the kernel took still write into the slots, so wait
+            // for them; opened files are closed here instead
+            unsigned waiting = batchSize - freeSlots.size() - ring.unsubmitted();
+            vector<Slot>* kept = &slots;
+            io_uring_cqe cqe;
+            while (waiting > 0) {
+                if (ring.popCqe(cqe)) {
+                    Slot& slot = slots[cqe.user_data];
+                    if (slot.stage == OPENING && cqe.res >= 0) {
+                        close(cqe.res);
+                    } else if (slot.stage == CLOSING) {
+                        slot.fd = -1;
+                    }
+                    waiting--;
+                } else if (!ring.wait()) {
+                    // The kernel may still write into the ring and buffers,
+                    // so they are left allocated rather than freed under it
+                    owner.release();
+                    kept = new vector<Slot>(std::move(slots));
+                    break;
+                }
+            }
+            vector<bool> busy(batchSize, true);
+            for (int s : freeSlots) {
+                busy[s] = false;
+            }
+            for (int s = 0; s < batchSize; s++) {
+                Slot& slot = (*kept)[s];
+                if (!busy[s]) {
+                    continue;
+                }
+                if (slot.stage != OPENING && slot.fd >= 0) {
+                    close(slot.fd);
+                }
+                remaining.push_back(slot.index);
+            }
+            for (size_t i = nextFile; i < files.size(); i++) {
+                remaining.push_back(i);
+            }
+            return true;
+        }
+
+        io_uring_cqe cqe;
+        while (ring.popCqe(cqe)) {
+            int s = (int) cqe.user_data;
+            Slot& slot = slots[s];
+            bool close = false;
+            if (slot.stage == OPENING) {
+                struct stat info;
+                if (cqe.res < 0) {
+                    callback(slot.index, slot.buffer, false);
+                    freeSlots.push_back(s);
+                    finished++;
+                    continue;
+                }
+                slot.fd = cqe.res;
+                if (fstat(slot.fd, &info) != 0) {
+                    close = true;
+                } else {
+                    slot.buffer.resize(info.st_size);
+                    slot.stage = READING;
+                    slot.ok = info.st_size == 0;
+                    close = slot.ok;
+                }
+            } else if (slot.stage == READING) {
+                if (cqe.res < 0) {
+                    close = true;
+                } else if (cqe.res == 0) {
+                    // The file shrank since it was opened
+                    slot.buffer.resize(slot.done);
+                    slot.ok = close = true;
+                } else {
+                    slot.done += cqe.res;
+                    slot.ok = close = slot.done == slot.buffer.size();
+                }
+            } else {
+                callback(slot.index, slot.buffer, slot.ok);
+                freeSlots.push_back(s);
+                finished++;
+                continue;
+            }
+
+            io_uring_sqe* sqe = ring.nextSqe();
+            sqe->fd = slot.fd;
+            sqe->user_data = s;
+            if (close) {
+                slot.stage = CLOSING;
+                sqe->opcode = IORING_OP_CLOSE;
+            } else {
+                sqe->opcode = IORING_OP_READ;
+                sqe->addr = (unsigned long) (&slot.buffer[0] + slot.done);
+                sqe->len = slot.buffer.size() - slot.done;
+                sqe->off = slot.done;
+            }
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Load files on a pool of threads, each opening, reading and closing one
+ * file at a time with blocking calls
+ */
+void FileLoader::loadWithThreads(const vector<string>& files, Callback& callback) {
+    int count = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+    atomic<size_t> nextFile(0);
+    mutex callbackLock;
+    vector<thread> workers;
+    for (int t = 0; t < count && t < (int) files.size(); t++) {
+        workers.push_back(thread([&]() {
+            for (size_t i = nextFile++; i < files.size(); i = nextFile++) {
+                string contents;
+                bool ok = false;
+                int fd = open(files[i].c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat info;
+                if (fd >= 0 && fstat(fd, &info) == 0) {
+                    contents.resize(info.st_size);
+                    size_t done = 0;
+                    ok = true;
+                    while (done < contents.size()) {
+                        ssize_t n = pread(fd, &contents[done], contents.size() - done, done);
+                        if (n < 0 && errno == EINTR) {
+                            continue;
+                        }
+                        if (n <= 0) {
+                            ok = n == 0;
+                            contents.resize(done);
+                            break;
+                        }
+                        done += n;
+                    }
+                }
+                if (fd >= 0) {
+                    close(fd);
+                }
+                lock_guard<mutex> guard(callbackLock);
+                callback(i, contents, ok);
+            }
+        }));
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
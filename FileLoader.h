@@ -0,0 +1,45 @@
+#ifndef FILELOADER_H
+#define FILELOADER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Loads many small files with their opens, reads and closes batched.
+ * On Linux the requests go through io_uring, keeping up to batchSize files
+ * in flight at once; where io_uring is unavailable a pool of threads reads
+ * the files with pread instead. Each file is handed to the callback as soon
+ * as it has been read, in completion order.
+ */
+class FileLoader {
+    public:
+        /**
+         * Called once per file. Calls from load() never overlap, but may come
+         * from any thread; see loadAndProcess() for its calls.
+         * @param index The file's position in the list passed to load()
+         * @param contents The file's contents; the callback may take them with std::move
+         * @param ok true if the file was read, false otherwise
+         */
+        typedef std::function<void(std::size_t index, std::string& contents, bool ok)> Callback;
+
+        FileLoader(int batchSize, int threads);
+
+        void setUseIoUring(bool useIoUring);
+        bool usedIoUring();
+
+        void load(const std::vector<std::string>& files, Callback callback);
+        void loadAndProcess(const std::vector<std::string>& files, Callback process);
+
+    private:
+        int batchSize;
+        int threads;
+        bool useIoUring;
+        bool lastUsedIoUring;
+
+        bool loadWithIoUring(const std::vector<std::string>& files, Callback& callback, std::vector<std::size_t>& remaining);
+        void loadWithThreads(const std::vector<std::string>& files, Callback& callback);
+};
+
+#endif /*FILELOADER_H*/
@@ -0,0 +1,123 @@
+#include "FileUtil.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+
+using namespace std;
+
+/**
+ * Read the whole of a file
+ * @param path The file to read
+ * @param contents Set to the file's contents
+ * @return true if the file was read, false otherwise
+ */
+bool FileUtil::readFile(const string& path, string& contents) {
+    ifstream in(path, ios::in | ios::binary);
+    if (!in) {
+        return false;
+    }
+    ostringstream buffer;
+    buffer << in.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+/**
+ * Replace the contents of a file, writing to a temporary file first so
+ * readers never see a partial file
+ * @param path The file to write
+ * @param contents The new contents
+ * @return true if the file was written, false otherwise
+ */
+bool FileUtil::writeFile(const string& path, const string& contents) {
+    // Unique per thread, so threads writing the same path do not collide
+    string temporary = path + ".tmp" + to_string(std::hash<thread::id>()(this_thread::get_id()));
+    {
+        ofstream out(temporary, ios::out | ios::binary | ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out.write(contents.data(), contents.size());
+        if (!out) {
+            return false;
+        }
+    }
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * Get the size and modification time of a file
+ * @param path The file to check
+ * @param stamp Set to the file's size and modification time
+ * @return true if the file exists, false otherwise
+ */
+bool FileUtil::stat(const string& path, FileStamp& stamp) {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    stamp.size = (uint64_t) info.st_size;
+#ifdef __APPLE__
+    stamp.mtime = (int64_t) info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    stamp.mtime = (int64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+/**
+ * Hash a file's contents with 64-bit FNV-1a
+ * @param contents The bytes to hash
+ * @return The hash
+ */
+uint64_t FileUtil::hash(const string& contents) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : contents) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * Find all .jack files in a directory and its subdirectories
+ * @param directory The directory to search
+ * @return The paths of the files found, sorted
+ */
+vector<string> FileUtil::listJackFiles(const string& directory) {
+    vector<string> files;
+    vector<string> pending;
+    pending.push_back(directory);
+    while (!pending.empty()) {
+        string current = pending.back();
+        pending.pop_back();
+        DIR* dir = opendir(current.c_str());
+        if (dir == NULL) {
+            continue;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            string path = current + "/" + name;
+            struct stat info;
+            if (::stat(path.c_str(), &info) != 0) {
+                continue;
+            }
+            if (S_ISDIR(info.st_mode)) {
+                pending.push_back(path);
+            } else if (name.size() > 5 && name.compare(name.size() - 5, 5, ".jack") == 0) {
+                files.push_back(path);
+            }
+        }
+        closedir(dir);
+    }
+    sort(files.begin(), files.end());
+    return files;
+}
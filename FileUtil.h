@@ -0,0 +1,26 @@
+#ifndef FILEUTIL_H
+#define FILEUTIL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Size and modification time of a file, used to detect changed files
+ * without reading them.
+ */
+struct FileStamp {
+    uint64_t size;
+    int64_t mtime;
+};
+
+class FileUtil {
+    public:
+        static bool readFile(const std::string& path, std::string& contents);
+        static bool writeFile(const std::string& path, const std::string& contents);
+        static bool stat(const std::string& path, FileStamp& stamp);
+        static uint64_t hash(const std::string& contents);
+        static std::vector<std::string> listJackFiles(const std::string& directory);
+};
+
+#endif /*FILEUTIL_H*/
@@ -0,0 +1,372 @@
+#include "IncrementalBuild.h"
+#include "CompilerParser.h"
+#include "FileLoader.h"
+#include "FileUtil.h"
+#include "MemoryStats.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * Join a set of names with commas
+ * @param names The names to join
+ * @return The joined names
+ */
+static string join(const set<string>& names) {
+    string result;
+    for (const string& name : names) {
+        if (!result.empty()) {
+            result += ',';
+        }
+        result += name;
+    }
+    return result;
+}
+
+/**
+ * Split text on a separator
+ * @param text The text to split
+ * @param separator The character separating fields
+ * @return The fields, including empty ones
+ */
+static vector<string> split(const string& text, char separator) {
+    vector<string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t end = text.find(separator, start);
+        if (end == string::npos) {
+            fields.push_back(text.substr(start));
+            return fields;
+        }
+        fields.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+/**
+ * Get the class named by a Class.method call reference
+ * @param call The call reference
+ * @return The class name
+ */
+static string callClass(const string& call) {
+    return call.substr(0, call.find('.'));
+}
+
+/**
+ * Constructor for the IncrementalBuild
+ * @param cacheDir The directory holding the manifest and cached outputs
+ */
+IncrementalBuild::IncrementalBuild(string cacheDir) {
+    IncrementalBuild::cacheDir = cacheDir;
+}
+
+string IncrementalBuild::manifestPath() {
+    return cacheDir + "/manifest";
+}
+
+string IncrementalBuild::outputPath(uint64_t hash) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.tree", (unsigned long long) hash);
+    return cacheDir + "/" + name;
+}
+
+/**
+ * Read the manifest written by the last build, if there is one
+ */
+void IncrementalBuild::loadManifest() {
+    manifest.clear();
+    string contents;
+    if (!FileUtil::readFile(manifestPath(), contents)) {
+        return;
+    }
+    istringstream lines(contents);
+    string line;
+    while (getline(lines, line)) {
+        // path, size, mtime, hash, ok, class, types, calls, subroutines
+        vector<string> fields = split(line, '\t');
+        if (fields.size() != 9) {
+            continue;
+        }
+        Entry e;
+        e.path = fields[0];
+        e.size = strtoull(fields[1].c_str(), NULL, 10);
+        e.mtime = strtoll(fields[2].c_str(), NULL, 10);
+        e.hash = strtoull(fields[3].c_str(), NULL, 16);
+        e.ok = fields[4] == "1";
+        e.className = fields[5];
+        for (int i = 6; i < 9; i++) {
+            set<string>& names = i == 6 ? e.types : i == 7 ? e.calls : e.subroutines;
+            for (const string& name : split(fields[i], ',')) {
+                if (!name.empty()) {
+                    names.insert(name);
+                }
+            }
+        }
+        manifest[e.path] = e;
+    }
+}
+
+/**
+ * Write the manifest for the next build
+ * @return true if the manifest was written, false otherwise
+ */
+bool IncrementalBuild::saveManifest() {
+    ostringstream out;
+    for (const auto& item : manifest) {
+        const Entry& e = item.second;
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long) e.hash);
+        out << e.path << '\t' << e.size << '\t' << e.mtime << '\t' << hash << '\t'
+            << (e.ok ? 1 : 0) << '\t' << e.className << '\t'
+            << join(e.types) << '\t' << join(e.calls) << '\t' << join(e.subroutines) << '\n';
+    }
+    return FileUtil::writeFile(manifestPath(), out.str());
+}
+
+/**
+ * Collect the class name, declared subroutines, and references to other
+ * classes from a class parse tree. Types come from classVarDec, varDec,
+ * parameterList and subroutine return types; calls from Class.method terms.
+ * @param tree A tree produced by CompilerParser::compileClass()
+ * @param entry The entry to fill in
+ */
+void IncrementalBuild::collectReferences(ParseTree* tree, Entry& entry) {
+    vector<ParseTree*> stack;
+    stack.push_back(tree);
+    while (!stack.empty()) {
+        ParseTree* node = stack.back();
+        stack.pop_back();
+        string type = node->getType();
+        vector<ParseTree*> children;
+        for (ParseTree::iterator it = node->childBegin(); it != node->childEnd(); it++) {
+            children.push_back(*it);
+            stack.push_back(*it);
+        }
+
+        if (type == "class" && children.size() > 1) {
+            entry.className = children[1]->getValue();
+        } else if ((type == "classVarDec" || type == "varDec") && children.size() > 1) {
+            if (children[1]->getType() == "identifier") {
+                entry.types.insert(children[1]->getValue());
+            }
+        } else if (type == "Subroutine" && children.size() > 2) {
+            if (children[1]->getType() == "identifier") {
+                entry.types.insert(children[1]->getValue());
+            }
+            entry.subroutines.insert(children[2]->getValue());
+        } else if (type == "parameterList") {
+            // type name (, type name)*
+            for (size_t i = 0; i < children.size(); i += 3) {
+                if (children[i]->getType() == "identifier") {
+                    entry.types.insert(children[i]->getValue());
+                }
+            }
+        } else if (type == "term" && children.size() > 2) {
+            if (children[0]->getType() == "identifier" && children[1]->getValue() == ".") {
+                entry.calls.insert(children[0]->getValue() + "." + children[2]->getValue());
+            }
+        }
+    }
+}
+
+/**
+ * Parse a file, filling in its references and caching its output
+ * @param entry The entry to fill in; path and hash must already be set
+ * @param source The file's contents
+ */
+void IncrementalBuild::parseFile(Entry& entry, const string& source) {
+    entry.ok = false;
+    entry.className.clear();
+    entry.types.clear();
+    entry.calls.clear();
+    entry.subroutines.clear();
+
+    ParseTree* tree = NULL;
+    try {
+        tree = CompilerParser::parseClass(source, false, NULL);
+        collectReferences(tree, entry);
+        entry.ok = FileUtil::writeFile(outputPath(entry.hash), tree->tostring());
+    } catch (ParseException& e) {
+    } catch (MemoryBudgetException& e) {
+    }
+    delete tree;
+}
+
+/**
+ * Build a project. Files are compared with the manifest by size and
+ * modification time first, and by content hash only when those differ, so
+ * an unchanged project is rebuilt without reading any source. Files that
+ * must be read are loaded in batches by a FileLoader, and each is hashed and
+ * parsed on a worker thread as soon as it arrives.
+ * @param files The source files in the project
+ * @param threads The number of parser threads, or 0 to use one per core
+ * @return How many files were parsed, validated, reused and failed, and any errors found
+ */
+IncrementalBuild::BuildStats IncrementalBuild::build(const vector<string>& files, int threads) {
+    BuildStats stats = {0, 0, 0, 0, vector<string>()};
+    mkdir(cacheDir.c_str(), 0755);
+    loadManifest();
+
+    map<string, Entry> next;
+    vector<string> stale;
+    vector<FileStamp> staleStamps;
+    for (const string& path : files) {
+        FileStamp stamp = {0, 0};
+        FileUtil::stat(path, stamp);
+        map<string, Entry>::iterator old = manifest.find(path);
+        if (old != manifest.end() && old->second.size == stamp.size && old->second.mtime == stamp.mtime) {
+            next[path] = old->second;
+        } else {
+            stale.push_back(path);
+            staleStamps.push_back(stamp);
+        }
+    }
+
+    // Files whose stamps changed are read in batches, and each is hashed,
+    // and parsed if its contents changed, as soon as it has been read. A
+    // file that cannot be read is left out of the manifest, so it is read
+    // again next time.
+    enum Outcome { UNREADABLE, UNCHANGED, CHANGED };
+    vector<Entry> staleEntries(stale.size());
+    vector<Outcome> outcomes(stale.size(), UNREADABLE);
+    FileLoader loader(LOAD_BATCH, threads);
+    loader.loadAndProcess(stale, [&](size_t i, string& contents, bool ok) {
+        if (!ok) {
+            return;
+        }
+        uint64_t hash = FileUtil::hash(contents);
+        map<string, Entry>::const_iterator old = manifest.find(stale[i]);
+        Entry& e = staleEntries[i];
+        if (old != manifest.end() && old->second.hash == hash) {
+            e = old->second;
+            outcomes[i] = UNCHANGED;
+        } else {
+            e.path = stale[i];
+            e.hash = hash;
+            parseFile(e, contents);
+            outcomes[i] = CHANGED;
+        }
+        e.size = staleStamps[i].size;
+        e.mtime = staleStamps[i].mtime;
+    });
+
+    vector<string> unreadable;
+    vector<Entry*> changed;
+    set<string> changedClasses;
+    for (size_t i = 0; i < stale.size(); i++) {
+        const string& path = stale[i];
+        if (outcomes[i] == UNREADABLE) {
+            unreadable.push_back(path);
+            continue;
+        }
+        Entry& e = next[path];
+        e = staleEntries[i];
+        if (outcomes[i] == CHANGED) {
+            map<string, Entry>::iterator old = manifest.find(path);
+            if (old != manifest.end()) {
+                changedClasses.insert(old->second.className);
+            }
+            changedClasses.insert(e.className);
+            changed.push_back(&e);
+        }
+    }
+    staleEntries.clear();
+    for (const auto& item : manifest) {
+        if (next.find(item.first) == next.end()) {
+            changedClasses.insert(item.second.className);
+        }
+    }
+    changedClasses.erase("");
+
+    // Files referring to a changed class keep their cached output, as their
+    // own source has not changed; their calls into the changed classes are
+    // checked again below
+    vector<Entry*> dependents;
+    set<Entry*> changedSet(changed.begin(), changed.end());
+    for (auto& item : next) {
+        Entry& e = item.second;
+        if (changedSet.count(&e) != 0) {
+            continue;
+        }
+        bool depends = false;
+        for (const string& type : e.types) {
+            depends = depends || changedClasses.count(type) != 0;
+        }
+        for (const string& call : e.calls) {
+            depends = depends || changedClasses.count(callClass(call)) != 0;
+        }
+        if (depends) {
+            dependents.push_back(&e);
+        }
+    }
+
+    // Check calls into project classes against the subroutines they declare.
+    // Every file is checked, not just the ones parsed in this build, so a
+    // file's errors are reported until it is fixed.
+    map<string, Entry*> classes;
+    for (auto& item : next) {
+        if (!item.second.className.empty()) {
+            classes[item.second.className] = &item.second;
+        }
+    }
+    for (const string& path : unreadable) {
+        stats.failed++;
+        stats.errors.push_back(path + ": could not be read");
+    }
+    for (auto& item : next) {
+        Entry& e = item.second;
+        if (!e.ok) {
+            stats.failed++;
+            stats.errors.push_back(e.path + ": could not be parsed");
+            continue;
+        }
+        for (const string& call : e.calls) {
+            map<string, Entry*>::iterator target = classes.find(callClass(call));
+            if (target != classes.end() && target->second->subroutines.count(call.substr(call.find('.') + 1)) == 0) {
+                stats.errors.push_back(e.path + ": " + call + " is not declared");
+            }
+        }
+    }
+
+    stats.parsed = changed.size();
+    stats.validated = dependents.size();
+    stats.reused = next.size() - changed.size() - dependents.size();
+
+    // With no stamp changed and no file removed, every entry was taken from
+    // the manifest unchanged, so there is nothing to write or remove
+    if (stale.empty() && next.size() == manifest.size()) {
+        return stats;
+    }
+
+    // Remove cached outputs no file refers to any more
+    set<uint64_t> live;
+    for (const auto& item : next) {
+        live.insert(item.second.hash);
+    }
+    for (const auto& item : manifest) {
+        if (live.count(item.second.hash) == 0) {
+            remove(outputPath(item.second.hash).c_str());
+        }
+    }
+    manifest.swap(next);
+    saveManifest();
+    return stats;
+}
+
+/**
+ * Get the cached output of a file from the last build
+ * @param path The source file
+ * @param output Set to the file's tostring() output
+ * @return true if the file was built successfully, false otherwise
+ */
+bool IncrementalBuild::getOutput(const string& path, string& output) {
+    map<string, Entry>::iterator e = manifest.find(path);
+    if (e == manifest.end() || !e->second.ok) {
+        return false;
+    }
+    return FileUtil::readFile(outputPath(e->second.hash), output);
+}
@@ -0,0 +1,64 @@
+#ifndef INCREMENTALBUILD_H
+#define INCREMENTALBUILD_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ParseTree.h"
+
+/**
+ * Incremental project builds. A manifest in the cache directory records each
+ * file's size, modification time, content hash, and the classes it refers
+ * to. A rebuild parses only the files whose contents changed and takes
+ * every other file's output from the cache. Files that refer to a changed
+ * class are counted as validated: their recorded calls are checked against
+ * the subroutines the class now declares, without parsing them again.
+ */
+class IncrementalBuild {
+    public:
+        struct BuildStats {
+            int parsed;
+            int validated;
+            int reused;
+            int failed;
+            std::vector<std::string> errors;
+        };
+
+        /** What the manifest records about one source file */
+        struct Entry {
+            std::string path;
+            uint64_t size;
+            int64_t mtime;
+            uint64_t hash;
+            bool ok;
+            std::string className;
+            std::set<std::string> types;
+            std::set<std::string> calls;
+            std::set<std::string> subroutines;
+        };
+
+        IncrementalBuild(std::string cacheDir);
+
+        BuildStats build(const std::vector<std::string>& files, int threads);
+        bool getOutput(const std::string& path, std::string& output);
+
+        static void collectReferences(ParseTree* tree, Entry& entry);
+
+    private:
+        // Files in flight at once when loading sources
+        static const int LOAD_BATCH = 64;
+
+        std::string cacheDir;
+        std::map<std::string, Entry> manifest;
+
+        std::string manifestPath();
+        std::string outputPath(uint64_t hash);
+        void loadManifest();
+        bool saveManifest();
+        void parseFile(Entry& entry, const std::string& source);
+};
+
+#endif /*INCREMENTALBUILD_H*/
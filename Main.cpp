@@ -1,12 +1,363 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <list>
+#include <stdexcept>
+#include <vector>
 
+#include "Benchmarks.h"
+#include "CodeGenerator.h"
 #include "CompilerParser.h"
+#include "ConstantFolder.h"
+#include "FileUtil.h"
+#include "IncrementalBuild.h"
+#include "MemoryStats.h"
+#include "Pipeline.h"
+#include "ProjectIndex.h"
+#include "StringInterner.h"
 #include "Token.h"
+#include "TreeIndex.h"
+#include "TreeRenderer.h"
+#include "VirtualMachine.h"
 
 using namespace std;
 
+/**
+ * Read, tokenize and parse one class file
+ * @param path The file to parse
+ * @param iterative true to parse in the CompilerParser's iterative mode
+ * @param fold true to run the ConstantFolder on the tree and print its report to cerr
+ * @param index The index to fill with the tree's nodes, or NULL for none.
+ *              Nodes are indexed as they are parsed, or after folding, as
+ *              the ConstantFolder replaces nodes.
+ * @return The class's parse tree; a ParseException is thrown if the file cannot be read or parsed
+ */
+static ParseTree* parseFile(const string& path, bool iterative, bool fold, TreeIndex* index) {
+    string source;
+    if (!FileUtil::readFile(path, source)) {
+        throw ParseException();
+    }
+    ParseTree* tree = CompilerParser::parseClass(source, iterative, fold ? NULL : index);
+    if (fold) {
+        try {
+            ConstantFolder folder;
+            folder.fold(tree);
+            cerr << path << ": " << folder.report();
+            if (index != NULL) {
+                index->rebuild(tree);
+            }
+        } catch (...) {
+            delete tree;
+            throw;
+        }
+    }
+    return tree;
+}
+
+/**
+ * Print the memory accounting and string interner reports
+ * @param memStats true if --mem-stats was given; nothing is printed otherwise
+ */
+static void printMemoryStats(bool memStats) {
+    if (memStats) {
+        cerr << MemoryStats::report();
+        cerr << StringInterner::global().report();
+    }
+}
+
+/**
+ * Check that the options given make sense together
+ * @return A message describing the first conflict, or empty if there is none
+ */
+static string checkOptions(bool build, bool index, bool render, bool query, bool vm, bool stream,
+        bool fold, bool iterative, bool project, bool lookups, bool files) {
+    int modes = build + index + render + query + vm + stream;
+    if (modes > 1) {
+        return "--build, --index, --render, --query, --vm/--run and --stream cannot be combined";
+    }
+    if (build && !project) {
+        return "--build needs --project";
+    }
+    if (project && !build && !index) {
+        return "--project needs --build or --index";
+    }
+    if (lookups && !index) {
+        return "--find-subroutine and --fields need --index";
+    }
+    if (fold && (build || index || stream)) {
+        return "--fold cannot be used with --build, --index or --stream";
+    }
+    if (iterative && (build || index)) {
+        return "--iterative cannot be used with --build or --index";
+    }
+    if ((build || index) && files) {
+        return "--build and --index take files from --project, not the command line";
+    }
+    if ((render || query || vm || stream) && !files) {
+        return "--render, --query, --vm, --run and --stream need input files";
+    }
+    return "";
+}
+
 int main(int argc, char *argv[]) {
+    bool memStats = false;
+    bool fold = false;
+    bool iterative = false;
+    bool stream = false;
+    bool emitVm = false;
+    bool runVm = false;
+    string indexPath;
+    string projectDir;
+    string buildDir;
+    string renderPath;
+    list<string> findSubroutines;
+    list<string> findFields;
+    list<string> queries;
+    vector<string> inputFiles;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mem-stats") == 0) {
+            memStats = true;
+        } else if (strcmp(argv[i], "--iterative") == 0) {
+            iterative = true;
+        } else if (strncmp(argv[i], "--bench-intern", 14) == 0) {
+            Benchmarks::internScaling(cout, argv[i][14] == '=' ? atoi(argv[i] + 15) : 0);
+            return 0;
+        } else if (strncmp(argv[i], "--bench-load=", 13) == 0) {
+            Benchmarks::fileLoading(cout, argv[i] + 13, 10000);
+            return 0;
+        } else if (strcmp(argv[i], "--bench-query") == 0) {
+            Benchmarks::treeQueries(cout);
+            return 0;
+        } else if (strncmp(argv[i], "--bench-render", 14) == 0) {
+            Benchmarks::rendering(cout, argv[i][14] == '=' ? atoi(argv[i] + 15) : 0);
+            return 0;
+        } else if (strncmp(argv[i], "--render=", 9) == 0) {
+            renderPath = argv[i] + 9;
+        } else if (strncmp(argv[i], "--query=", 8) == 0) {
+            queries.push_back(argv[i] + 8);
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[i], "--vm") == 0) {
+            emitVm = true;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            runVm = true;
+        } else if (strcmp(argv[i], "--fold") == 0) {
+            fold = true;
+        } else if (strncmp(argv[i], "--mem-budget=", 13) == 0) {
+            MemoryStats::setBudget(strtoull(argv[i] + 13, NULL, 10));
+        } else if (strncmp(argv[i], "--index=", 8) == 0) {
+            indexPath = argv[i] + 8;
+        } else if (strncmp(argv[i], "--build=", 8) == 0) {
+            buildDir = argv[i] + 8;
+        } else if (strncmp(argv[i], "--project=", 10) == 0) {
+            projectDir = argv[i] + 10;
+        } else if (strncmp(argv[i], "--find-subroutine=", 18) == 0) {
+            findSubroutines.push_back(argv[i] + 18);
+        } else if (strncmp(argv[i], "--fields=", 9) == 0) {
+            findFields.push_back(argv[i] + 9);
+        } else if (argv[i][0] != '-') {
+            inputFiles.push_back(argv[i]);
+        } else {
+            cerr << "Unknown option " << argv[i] << endl;
+            return 2;
+        }
+    }
+    string conflict = checkOptions(!buildDir.empty(), !indexPath.empty(), !renderPath.empty(), !queries.empty(),
+        emitVm || runVm, stream, fold, iterative, !projectDir.empty(), !findSubroutines.empty() || !findFields.empty(),
+        !inputFiles.empty());
+    if (!conflict.empty()) {
+        cerr << conflict << endl;
+        return 2;
+    }
+    MemoryStats::beginSession();
+
+    if (!buildDir.empty()) {
+        IncrementalBuild build(buildDir);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        IncrementalBuild::BuildStats stats = build.build(FileUtil::listJackFiles(projectDir), 0);
+        long elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        cout << "built: " << stats.parsed << " parsed, " << stats.validated << " validated, "
+             << stats.reused << " reused, " << stats.failed << " failed in " << elapsed << " ms" << endl;
+        for (string error : stats.errors) {
+            cout << error << endl;
+        }
+        printMemoryStats(memStats);
+        return stats.errors.empty() ? 0 : 1;
+    }
+
+    if (!indexPath.empty()) {
+        ProjectIndex index;
+        if (!projectDir.empty()) {
+            ProjectIndex::BuildStats stats = index.build(FileUtil::listJackFiles(projectDir), indexPath, 0);
+            cout << "indexed " << index.getFileCount() << " files: " << stats.parsed << " parsed, "
+                 << stats.reused << " reused, " << stats.failed << " failed" << endl;
+        } else if (!index.open(indexPath)) {
+            cout << "Error opening index!" << endl;
+            return 1;
+        }
+        for (string name : findSubroutines) {
+            for (ProjectIndex::Subroutine s : index.findSubroutine(name)) {
+                cout << s.className << "." << s.name << " " << s.kind << " " << s.returnType << " (" << s.file << ")" << endl;
+            }
+        }
+        for (string name : findFields) {
+            for (ProjectIndex::Field f : index.getFields(name)) {
+                cout << f.className << "." << f.name << " " << f.kind << " " << f.type << " (" << f.file << ")" << endl;
+            }
+        }
+        printMemoryStats(memStats);
+        return 0;
+    }
+
+    if (!inputFiles.empty() && !renderPath.empty()) {
+        // Parse every class, then print them all into the file at once
+        vector<ParseTree*> trees;
+        int failed = 0;
+        for (string path : inputFiles) {
+            try {
+                trees.push_back(parseFile(path, iterative, fold, NULL));
+            } catch (ParseException& e) {
+                cout << "Error Parsing! " << path << endl;
+                failed++;
+            } catch (MemoryBudgetException& e) {
+                cout << "Error Parsing! " << path << " " << e.what() << endl;
+                failed++;
+            }
+        }
+        TreeRenderer renderer(0);
+        if (!renderer.renderToFile(trees, renderPath)) {
+            cout << "Error writing " << renderPath << endl;
+            failed++;
+        }
+        for (ParseTree* tree : trees) {
+            delete tree;
+        }
+        printMemoryStats(memStats);
+        return failed > 0 ? 1 : 0;
+    }
+
+    if (!inputFiles.empty() && !queries.empty()) {
+        // Print the nodes each selector matches, with their names
+        int failed = 0;
+        for (string path : inputFiles) {
+            ParseTree* tree = NULL;
+            TreeIndex index;
+            try {
+                tree = parseFile(path, iterative, fold, &index);
+                for (string selector : queries) {
+                    const vector<ParseTree*>& matches = index.select(selector);
+                    cout << path << ": " << selector << ": " << matches.size() << " matches" << endl;
+                    for (ParseTree* match : matches) {
+                        cout << "  " << match->getType();
+                        for (ParseTree::iterator it = match->childBegin(); it != match->childEnd(); it++) {
+                            if ((*it)->getType() == "identifier") {
+                                cout << " " << (*it)->getValue();
+                            }
+                        }
+                        cout << endl;
+                    }
+                }
+            } catch (ParseException& e) {
+                cout << "Error Parsing!" << endl;
+                failed++;
+            } catch (MemoryBudgetException& e) {
+                cout << "Error Parsing! " << e.what() << endl;
+                failed++;
+            } catch (invalid_argument& e) {
+                cout << e.what() << endl;
+                failed++;
+            }
+            delete tree;
+        }
+        printMemoryStats(memStats);
+        return failed > 0 ? 1 : 0;
+    }
+
+    if (!inputFiles.empty() && (emitVm || runVm)) {
+        // Translate every class, then run Main.main
+        VirtualMachine vm;
+        int status = 0;
+        try {
+            for (string path : inputFiles) {
+                ParseTree* tree = parseFile(path, iterative, fold, NULL);
+                try {
+                    CodeGenerator generator;
+                    string code = generator.compileClass(tree);
+                    if (emitVm) {
+                        cout << code;
+                    }
+                    vm.load(code);
+                } catch (...) {
+                    delete tree;
+                    throw;
+                }
+                delete tree;
+            }
+            if (runVm) {
+                int result = vm.run("Main.main");
+                cout << vm.getOutput();
+                cout << "Main.main returned " << result << endl;
+                cerr << vm.report();
+            }
+        } catch (ParseException& e) {
+            cout << "Error Parsing!" << endl;
+            status = 1;
+        } catch (MemoryBudgetException& e) {
+            cout << "Error Parsing! " << e.what() << endl;
+            status = 1;
+        } catch (CodeGenException& e) {
+            cout << "Error Compiling! " << e.what() << endl;
+            status = 1;
+        } catch (VMException& e) {
+            cout << vm.getOutput();
+            cout << "Error Running! " << e.what() << endl;
+            status = 1;
+        }
+        printMemoryStats(memStats);
+        return status;
+    }
+
+    if (!inputFiles.empty() && stream) {
+        // One class per file, tokenized as it is parsed and written member
+        // by member
+        int failed = 0;
+        for (string path : inputFiles) {
+            try {
+                ifstream in(path, ios::in | ios::binary);
+                if (!in) {
+                    throw ParseException();
+                }
+                list<Token*> none;
+                CompilerParser parser(none);
+                parser.setSource(&in, 4096);
+                parser.setIterative(iterative);
+                delete parser.compileClass(cout);
+            } catch (ParseException& e) {
+                cout << "Error Parsing!" << endl;
+                failed++;
+            } catch (MemoryBudgetException& e) {
+                cout << "Error Parsing! " << e.what() << endl;
+                failed++;
+            }
+        }
+        printMemoryStats(memStats);
+        return failed > 0 ? 1 : 0;
+    }
+
+    if (!inputFiles.empty()) {
+        Pipeline pipeline(64 * 1024, 64);
+        pipeline.setIterative(iterative);
+        pipeline.setFold(fold, &cerr);
+        Pipeline::Stats stats = pipeline.run(inputFiles, cout);
+        if (stats.failed > 0) {
+            cout << "Error Parsing!" << endl;
+        }
+        printMemoryStats(memStats);
+        return stats.failed > 0 ? 1 : 0;
+    }
+
     /* Tokens for:
      *     class MyClass {
      *
@@ -36,11 +387,21 @@ int main(int argc, char *argv[]) {
 
     try {
         CompilerParser parser(tokens);
+        parser.setIterative(iterative);
         ParseTree* result = parser.compileSubroutine();
+        if (result != NULL && fold){
+            ConstantFolder folder;
+            folder.fold(result);
+            cerr << folder.report();
+        }
         if (result != NULL){
             cout << result->tostring() << endl;
         }
-    } catch (ParseException e) {
+    } catch (ParseException& e) {
         cout << "Error Parsing!" << endl;
+    } catch (MemoryBudgetException& e) {
+        cout << "Error Parsing! " << e.what() << endl;
     }
+
+    printMemoryStats(memStats);
 }
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "MemoryStats.h"
+
+#include <sstream>
+#include <sys/resource.h>
+
+using namespace std;
+
+atomic<size_t> MemoryStats::bytes[MemoryStats::NUM_CATEGORIES];
+atomic<size_t> MemoryStats::allocations[MemoryStats::NUM_CATEGORIES];
+atomic<size_t> MemoryStats::peak[MemoryStats::NUM_CATEGORIES];
+atomic<size_t> MemoryStats::totalBytes(0);
+atomic<size_t> MemoryStats::totalPeak(0);
+atomic<size_t> MemoryStats::budget(0);
+
+/**
+ * Raise a peak counter to at least the given value
+ * @param counter The peak to update
+ * @param value The candidate peak
+ */
+static void raisePeak(atomic<size_t>& counter, size_t value) {
+    size_t seen = counter.load(memory_order_relaxed);
+    while (value > seen && !counter.compare_exchange_weak(seen, value, memory_order_relaxed)) {
+    }
+}
+
+/**
+ * Record an allocation. Throws a MemoryBudgetException, without recording
+ * anything, if the allocation would take the total over the budget.
+ * STRINGS are recorded but never charged to the budget: they belong to
+ * StringInterner::global(), which keeps them for the life of the process,
+ * so they would otherwise count against every later session.
+ * @param category The category the memory belongs to
+ * @param bytes The number of bytes allocated
+ */
+void MemoryStats::allocate(Category category, size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    size_t total = totalBytes.fetch_add(bytes, memory_order_relaxed) + bytes;
+    size_t limit = budget.load(memory_order_relaxed);
+    size_t strings = MemoryStats::bytes[STRINGS].load(memory_order_relaxed);
+    if (limit != 0 && category != STRINGS && total > strings && total - strings > limit) {
+        totalBytes.fetch_sub(bytes, memory_order_relaxed);
+        throw MemoryBudgetException();
+    }
+    raisePeak(totalPeak, total);
+
+    size_t current = MemoryStats::bytes[category].fetch_add(bytes, memory_order_relaxed) + bytes;
+    allocations[category].fetch_add(1, memory_order_relaxed);
+    raisePeak(peak[category], current);
+}
+
+/**
+ * Record that memory previously passed to allocate() has been freed
+ * @param category The category the memory belongs to
+ * @param bytes The number of bytes freed
+ */
+void MemoryStats::release(Category category, size_t bytes) {
+    MemoryStats::bytes[category].fetch_sub(bytes, memory_order_relaxed);
+    totalBytes.fetch_sub(bytes, memory_order_relaxed);
+}
+
+/**
+ * Start a new parse session. Peaks are reset to the memory currently in use.
+ */
+void MemoryStats::beginSession() {
+    for (int i = 0; i < NUM_CATEGORIES; i++) {
+        peak[i].store(bytes[i].load(memory_order_relaxed), memory_order_relaxed);
+    }
+    totalPeak.store(totalBytes.load(memory_order_relaxed), memory_order_relaxed);
+}
+
+/**
+ * Set the maximum number of accounted bytes, not counting STRINGS
+ * @param bytes The budget, or 0 for no limit
+ */
+void MemoryStats::setBudget(size_t bytes) {
+    budget.store(bytes, memory_order_relaxed);
+}
+
+/**
+ * Get the maximum number of accounted bytes
+ * @return The budget, or 0 if there is no limit
+ */
+size_t MemoryStats::getBudget() {
+    return budget.load(memory_order_relaxed);
+}
+
+/**
+ * Get the bytes currently in use by a category
+ * @return The number of bytes
+ */
+size_t MemoryStats::getBytes(Category category) {
+    return bytes[category].load(memory_order_relaxed);
+}
+
+/**
+ * Get the number of allocations ever made by a category
+ * @return The allocation count
+ */
+size_t MemoryStats::getAllocations(Category category) {
+    return allocations[category].load(memory_order_relaxed);
+}
+
+/**
+ * Get the most bytes used by a category during this session
+ * @return The peak number of bytes
+ */
+size_t MemoryStats::getPeak(Category category) {
+    return peak[category].load(memory_order_relaxed);
+}
+
+/**
+ * Get the bytes currently in use across all categories
+ * @return The number of bytes
+ */
+size_t MemoryStats::getTotalBytes() {
+    return totalBytes.load(memory_order_relaxed);
+}
+
+/**
+ * Get the most bytes in use at once across all categories during this session
+ * @return The peak number of bytes
+ */
+size_t MemoryStats::getTotalPeak() {
+    return totalPeak.load(memory_order_relaxed);
+}
+
+/**
+ * Get the peak resident set size of the process as reported by the OS
+ * @return The peak RSS in bytes
+ */
+size_t MemoryStats::getPeakRSS() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (size_t) usage.ru_maxrss;
+#else
+    return (size_t) usage.ru_maxrss * 1024;
+#endif
+}
+
+/**
+ * Get the heap memory owned by a string. Short strings stored inline in the
+ * string object itself own no heap memory.
+ * @param s The string
+ * @return The number of heap bytes
+ */
+size_t MemoryStats::heapBytes(const string& s) {
+    const char* data = s.data();
+    const char* object = (const char*) &s;
+    if (data >= object && data < object + sizeof(string)) {
+        return 0;
+    }
+    return s.capacity() + 1;
+}
+
+/**
+ * Get a printable name for a category
+ * @return The category name
+ */
+const char* MemoryStats::categoryName(Category category) {
+    switch (category) {
+        case TOKENS: return "tokens";
+        case TREE_NODES: return "tree nodes";
+        case CHILD_LISTS: return "child lists";
+        case STRINGS: return "strings";
+        case OUTPUT_BUFFERS: return "output buffers";
+        default: return "unknown";
+    }
+}
+
+/**
+ * Generate a report of the current memory usage
+ * @return A printable table of usage per category
+ */
+string MemoryStats::report() {
+    ostringstream out;
+    out << "memory stats\n";
+    for (int i = 0; i < NUM_CATEGORIES; i++) {
+        Category category = (Category) i;
+        out << "  " << categoryName(category) << ": "
+            << getBytes(category) << " bytes in use, "
+            << getPeak(category) << " bytes peak, "
+            << getAllocations(category) << " allocations\n";
+    }
+    out << "  total: " << getTotalBytes() << " bytes in use, " << getTotalPeak() << " bytes peak\n";
+    if (getBudget() != 0) {
+        out << "  budget: " << getBudget() << " bytes\n";
+    }
+    out << "  peak RSS: " << getPeakRSS() << " bytes\n";
+    return out.str();
+}
+
+/**
+ * Definition of a MemoryBudgetException
+ * Thrown when an accounted allocation would exceed the configured budget.
+ */
+const char* MemoryBudgetException::what() const noexcept {
+    return "The memory budget for this parse was exceeded!";
+}
@@ -0,0 +1,59 @@
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <string>
+
+/**
+ * Process-wide memory accounting for parse sessions.
+ * Bytes and allocation counts are tracked per category, along with the
+ * peak of the current session. An optional budget makes allocations fail
+ * with a MemoryBudgetException instead of growing without bound; interned
+ * STRINGS, which outlive sessions, are tracked but not budgeted.
+ */
+class MemoryStats {
+    public:
+        enum Category {
+            TOKENS,
+            TREE_NODES,
+            CHILD_LISTS,
+            STRINGS,
+            OUTPUT_BUFFERS,
+            NUM_CATEGORIES
+        };
+
+        static void allocate(Category category, std::size_t bytes);
+        static void release(Category category, std::size_t bytes);
+
+        static void beginSession();
+        static void setBudget(std::size_t bytes);
+        static std::size_t getBudget();
+
+        static std::size_t getBytes(Category category);
+        static std::size_t getAllocations(Category category);
+        static std::size_t getPeak(Category category);
+        static std::size_t getTotalBytes();
+        static std::size_t getTotalPeak();
+        static std::size_t getPeakRSS();
+
+        static std::size_t heapBytes(const std::string& s);
+        static const char* categoryName(Category category);
+        static std::string report();
+
+    private:
+        static std::atomic<std::size_t> bytes[NUM_CATEGORIES];
+        static std::atomic<std::size_t> allocations[NUM_CATEGORIES];
+        static std::atomic<std::size_t> peak[NUM_CATEGORIES];
+        static std::atomic<std::size_t> totalBytes;
+        static std::atomic<std::size_t> totalPeak;
+        static std::atomic<std::size_t> budget;
+};
+
+class MemoryBudgetException : public std::exception {
+    public:
+        const char* what() const noexcept;
+};
+
+#endif /*MEMORYSTATS_H*/
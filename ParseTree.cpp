@@ -1,15 +1,61 @@
 #include "ParseTree.h"
+#include "MemoryStats.h"
+#include "StringInterner.h"
+
+#include <algorithm>
+#include <vector>
 
 using namespace std;
 
+// Size of one std::list node holding a child pointer (two links and the pointer)
+static const size_t CHILD_NODE_BYTES = 3 * sizeof(void*);
+
 /**
  * A node in a Parse Tree data structure
  * @param type The type of node (see element types).
  * @param value The node's value. This should only be present on terminal nodes/leaves, and empty otherwise.
  */
 ParseTree::ParseTree(string type, string value) {
-    ParseTree::type = type;
-    ParseTree::value = value;
+    ParseTree::type = &StringInterner::global().canonical(type);
+    ParseTree::value = &StringInterner::global().canonical(value);
+    ParseTree::parent = NULL;
+}
+
+/**
+ * Deletes this ParseTree along with all of its children. Descendants are
+ * collected into a worklist rather than deleted recursively, so trees of
+ * any depth can be freed.
+ */
+ParseTree::~ParseTree() {
+    MemoryStats::release(MemoryStats::CHILD_LISTS, ParseTree::children.size() * CHILD_NODE_BYTES);
+    list<ParseTree*> pending;
+    pending.swap(ParseTree::children);
+    while (!pending.empty()) {
+        ParseTree* node = pending.front();
+        pending.pop_front();
+        MemoryStats::release(MemoryStats::CHILD_LISTS, node->children.size() * CHILD_NODE_BYTES);
+        pending.splice(pending.end(), node->children);
+        delete node;
+    }
+}
+
+/**
+ * Allocates memory for a ParseTree node, counted as a tree node
+ * @param size The number of bytes to allocate
+ */
+void* ParseTree::operator new(size_t size) {
+    MemoryStats::allocate(MemoryStats::TREE_NODES, size);
+    return ::operator new(size);
+}
+
+/**
+ * Frees memory for a ParseTree node
+ * @param p The node to free
+ * @param size The number of bytes allocated for the node
+ */
+void ParseTree::operator delete(void* p, size_t size) {
+    MemoryStats::release(MemoryStats::TREE_NODES, size);
+    ::operator delete(p);
 }
 
 /**
@@ -17,7 +63,9 @@ ParseTree::ParseTree(string type, string value) {
  * @param child The ParseTree to add
  */
 void ParseTree::addChild(ParseTree* child) {
+    MemoryStats::allocate(MemoryStats::CHILD_LISTS, CHILD_NODE_BYTES);
     ParseTree::children.push_back(child);
+    child->parent = this;
 }
 
 /**
@@ -28,12 +76,63 @@ list<ParseTree*> ParseTree::getChildren() {
     return ParseTree::children;
 }
 
+/**
+ * Get an iterator to the first child, for editing the tree in place
+ * @return An iterator over this node's children
+ */
+ParseTree::iterator ParseTree::childBegin() {
+    return ParseTree::children.begin();
+}
+
+/**
+ * Get an iterator past the last child
+ * @return An iterator over this node's children
+ */
+ParseTree::iterator ParseTree::childEnd() {
+    return ParseTree::children.end();
+}
+
+/**
+ * Inserts a ParseTree as a child of this ParseTree
+ * @param position The child to insert before
+ * @param child The ParseTree to add
+ * @return An iterator to the inserted child
+ */
+ParseTree::iterator ParseTree::insertChild(iterator position, ParseTree* child) {
+    MemoryStats::allocate(MemoryStats::CHILD_LISTS, CHILD_NODE_BYTES);
+    child->parent = this;
+    return ParseTree::children.insert(position, child);
+}
+
+/**
+ * Removes a child from this ParseTree and deletes it
+ * @param position The child to remove
+ * @return An iterator to the child after the one removed
+ */
+ParseTree::iterator ParseTree::eraseChild(iterator position) {
+    delete *position;
+    MemoryStats::release(MemoryStats::CHILD_LISTS, CHILD_NODE_BYTES);
+    return ParseTree::children.erase(position);
+}
+
+/**
+ * Moves all of another ParseTree's children into this one, leaving it empty
+ * @param position The child to insert before
+ * @param from The ParseTree to take the children from
+ */
+void ParseTree::spliceChildren(iterator position, ParseTree* from) {
+    for (ParseTree* child : from->children) {
+        child->parent = this;
+    }
+    ParseTree::children.splice(position, from->children);
+}
+
 /**
  * Get the type of this Node
  * @return The type of node (see element types).
  */
 string ParseTree::getType() {
-    return ParseTree::type;
+    return *ParseTree::type;
 }
 
 /**
@@ -41,9 +140,33 @@ string ParseTree::getType() {
  * @return The node's value. This should only be used on terminal nodes/leaves, and empty otherwise.
  */
 string ParseTree::getValue() {
+    return *ParseTree::value;
+}
+
+/**
+ * Get the shared copy of this Node's type, for comparing types by address
+ * @return The type, owned by StringInterner::global()
+ */
+const string* ParseTree::internedType() {
+    return ParseTree::type;
+}
+
+/**
+ * Get the shared copy of this Node's value, for comparing values by address
+ * @return The value, owned by StringInterner::global()
+ */
+const string* ParseTree::internedValue() {
     return ParseTree::value;
 }
 
+/**
+ * Get the node this Node was added to as a child
+ * @return The parent, or NULL for the root of a tree
+ */
+ParseTree* ParseTree::getParent() {
+    return ParseTree::parent;
+}
+
 /**
  * Generate a string from this ParseTree
  * @return A printable representation of this ParseTree
@@ -53,28 +176,81 @@ string ParseTree::tostring() {
 }
 
 /**
- * Generate a string from this ParseTree
+ * Make room in an output buffer, checking the memory budget before it grows
+ * @param output The buffer
+ * @param more The number of bytes about to be appended
+ * @param accounted The bytes recorded for the buffer so far; updated
+ */
+static void reserveOutput(string& output, size_t more, size_t& accounted) {
+    size_t needed = output.size() + more;
+    if (needed <= output.capacity()) {
+        return;
+    }
+    size_t capacity = max(needed, output.capacity() * 2);
+    MemoryStats::allocate(MemoryStats::OUTPUT_BUFFERS, capacity - accounted);
+    accounted = capacity;
+    output.reserve(capacity);
+}
+
+/**
+ * Generate a string from this ParseTree. Uses an explicit stack rather than
+ * recursion, so trees of any depth can be printed. The output buffer is
+ * charged to the memory budget before each time it grows.
  * @return A printable representation of this ParseTree with indentation
  */
 string ParseTree::tostring(int depth) {
-    // Set indentation
+    const string unit = "  \u2502 ";
+    const string branch = "  \u2514 ";
     string indent = "";
     for (int i = 0; i < depth; i++) {
-        indent += "  \u2502 ";
+        indent += unit;
     }
 
-    // Generate output
-    string output = "";
-    if (ParseTree::children.size() > 0) {
-        // Output if the node has children
-        output += ParseTree::type + "\n";
-        for (ParseTree* child : children) {
-            output += indent + "  \u2514 " + child->tostring(depth + 1);
-        }
-        output += indent + "\n";
-    } else {
+    if (ParseTree::children.size() == 0) {
         // Output if the node is a leaf/terminal
-        output += ParseTree::type + " " + ParseTree::value + "\n";
+        return *ParseTree::type + " " + *ParseTree::value + "\n";
     }
+
+    // Each frame is a node with children and the next child to output
+    struct Frame {
+        ParseTree* node;
+        list<ParseTree*>::iterator next;
+    };
+    vector<Frame> stack;
+    string output;
+    size_t accounted = 0;
+    try {
+        reserveOutput(output, ParseTree::type->size() + 1, accounted);
+        output += *ParseTree::type + "\n";
+        stack.push_back(Frame{this, ParseTree::children.begin()});
+        while (!stack.empty()) {
+            Frame& top = stack.back();
+            if (top.next == top.node->children.end()) {
+                reserveOutput(output, indent.size() + 1, accounted);
+                output += indent + "\n";
+                stack.pop_back();
+                if (!stack.empty()) {
+                    indent.resize(indent.size() - unit.size());
+                }
+                continue;
+            }
+            ParseTree* child = *top.next++;
+            reserveOutput(output, indent.size() + branch.size() + child->type->size() + child->value->size() + 2, accounted);
+            output += indent + branch;
+            if (child->children.size() > 0) {
+                // Output if the node has children
+                output += *child->type + "\n";
+                indent += unit;
+                stack.push_back(Frame{child, child->children.begin()});
+            } else {
+                // Output if the node is a leaf/terminal
+                output += *child->type + " " + *child->value + "\n";
+            }
+        }
+    } catch (...) {
+        MemoryStats::release(MemoryStats::OUTPUT_BUFFERS, accounted);
+        throw;
+    }
+    MemoryStats::release(MemoryStats::OUTPUT_BUFFERS, accounted);
     return output;
-}
\ No newline at end of file
+}
@@ -1,26 +1,53 @@
 #ifndef PARSETREE_H
 #define PARSETREE_H
 
+#include <cstddef>
 #include <string>
 #include <list>
 
 class ParseTree {
     private:
-        std::string type;
-        std::string value;
+        // Shared copies owned by StringInterner::global()
+        const std::string* type;
+        const std::string* value;
+        ParseTree* parent;
         std::list<ParseTree*> children;
 
     public:
+        typedef std::list<ParseTree*>::iterator iterator;
+
         ParseTree(std::string type, std::string value);
 
+        virtual ~ParseTree();
+
+        static void* operator new(std::size_t size);
+
+        static void operator delete(void* p, std::size_t size);
+
         void addChild(ParseTree* child);
 
         std::list<ParseTree*> getChildren();
 
+        iterator childBegin();
+
+        iterator childEnd();
+
+        iterator insertChild(iterator position, ParseTree* child);
+
+        iterator eraseChild(iterator position);
+
+        void spliceChildren(iterator position, ParseTree* from);
+
         std::string getType();
 
         std::string getValue();
 
+        const std::string* internedType();
+
+        const std::string* internedValue();
+
+        ParseTree* getParent();
+
         std::string tostring();
 
         std::string tostring(int depth);
@@ -0,0 +1,221 @@
+#include "Pipeline.h"
+#include "BoundedQueue.h"
+#include "CompilerParser.h"
+#include "ConstantFolder.h"
+#include "FileLoader.h"
+#include "MemoryStats.h"
+#include "Tokenizer.h"
+
+#include <algorithm>
+#include <new>
+#include <thread>
+
+using namespace std;
+
+/**
+ * Delete a list of tokens
+ * @param tokens The tokens to delete
+ */
+static void deleteTokens(list<Token*>& tokens) {
+    for (Token* token : tokens) {
+        delete token;
+    }
+    tokens.clear();
+}
+
+/**
+ * Constructor for the Pipeline
+ * @param chunkSize The number of bytes of a file tokenized at a time
+ * @param queueCapacity The most items waiting between two stages
+ */
+Pipeline::Pipeline(size_t chunkSize, size_t queueCapacity) {
+    Pipeline::chunkSize = chunkSize;
+    Pipeline::queueCapacity = queueCapacity;
+    iterative = false;
+    fold = false;
+    foldReport = NULL;
+}
+
+/**
+ * Choose whether classes are parsed in the CompilerParser's iterative mode
+ * @param iterative true to parse without recursion, false otherwise
+ */
+void Pipeline::setIterative(bool iterative) {
+    Pipeline::iterative = iterative;
+}
+
+/**
+ * Choose whether each class is constant folded before it is written
+ * @param fold true to run the ConstantFolder on every tree, false otherwise
+ * @param report The stream each class's folding report is written to,
+ *               prefixed with its file, or NULL to discard the reports
+ */
+void Pipeline::setFold(bool fold, ostream* report) {
+    Pipeline::fold = fold;
+    foldReport = report;
+}
+
+/**
+ * Parse every class in a set of files and write their trees, in order
+ * @param files The source files to parse
+ * @param out The stream each class's tostring() is written to
+ * @return How many files and classes were processed, and how many failed
+ */
+Pipeline::Stats Pipeline::run(const vector<string>& files, ostream& out) {
+    Stats stats = {0, 0, 0};
+    BoundedQueue<Chunk> chunks(queueCapacity);
+    BoundedQueue<TokenBatch> batches(queueCapacity);
+    BoundedQueue<ClassTree> trees(queueCapacity);
+
+    thread reader([&]() {
+        // Files are loaded a batch at a time by a FileLoader, which returns
+        // them in completion order, and then cut into chunks in file order
+        FileLoader loader(LOAD_BATCH, 0);
+        for (size_t first = 0; first < files.size(); first += LOAD_BATCH) {
+            size_t last = min(files.size(), first + LOAD_BATCH);
+            vector<string> batch(files.begin() + first, files.begin() + last);
+            vector<string> contents(batch.size());
+            vector<char> loaded(batch.size(), 0);
+            try {
+                loader.load(batch, [&](size_t i, string& text, bool ok) {
+                    contents[i].swap(text);
+                    loaded[i] = ok;
+                });
+            } catch (...) {
+                // Files not yet loaded are counted as failed below
+            }
+            for (size_t i = 0; i < batch.size(); i++) {
+                bool failed = !loaded[i];
+                try {
+                    for (size_t offset = 0; !failed && offset < contents[i].size(); offset += chunkSize) {
+                        chunks.push(Chunk{contents[i].substr(offset, chunkSize), false, false});
+                    }
+                } catch (...) {
+                    failed = true;
+                }
+                string().swap(contents[i]);
+                chunks.push(Chunk{"", true, failed});
+            }
+        }
+        chunks.close();
+    });
+
+    thread tokenizer([&]() {
+        Tokenizer tokens;
+        bool failed = false;
+        Chunk chunk;
+        while (chunks.pop(chunk)) {
+            TokenBatch batch;
+            batch.endOfFile = chunk.endOfFile;
+            batch.failed = chunk.failed;
+            try {
+                if (!failed && !chunk.failed) {
+                    if (chunk.endOfFile) {
+                        tokens.finish(batch.tokens);
+                    } else {
+                        tokens.feed(chunk.text, batch.tokens);
+                    }
+                }
+            } catch (...) {
+                // Any failure, including running out of memory, fails only
+                // this file; an exception must not escape the thread
+                failed = true;
+            }
+            if (failed) {
+                deleteTokens(batch.tokens);
+                batch.failed = true;
+            }
+            if (chunk.endOfFile) {
+                tokens = Tokenizer();
+                failed = false;
+            }
+            batches.push(std::move(batch));
+        }
+        batches.close();
+    });
+
+    thread parser([&]() {
+        list<Token*> pending;
+        size_t file = 0;
+        int depth = 0;
+        bool failed = false;
+        TokenBatch batch;
+        while (batches.pop(batch)) {
+            failed = failed || batch.failed;
+            for (list<Token*>::iterator it = batch.tokens.begin(); it != batch.tokens.end() && !failed;) {
+                Token* token = *it;
+                pending.splice(pending.end(), batch.tokens, it++);
+                if (token->getType() != "symbol") {
+                    continue;
+                }
+                if (token->getValue() == "{") {
+                    depth++;
+                } else if (token->getValue() == "}" && --depth == 0) {
+                    // A complete class is pending
+                    ClassTree result = {NULL, false, ""};
+                    try {
+                        CompilerParser classParser(pending);
+                        classParser.setIterative(iterative);
+                        result.tree = classParser.compileClass();
+                        if (fold) {
+                            ConstantFolder folder;
+                            folder.fold(result.tree);
+                            result.foldReport = files[file] + ": " + folder.report();
+                        }
+                    } catch (...) {
+                        result.failed = true;
+                    }
+                    if (result.failed) {
+                        delete result.tree;
+                        result.tree = NULL;
+                    }
+                    deleteTokens(pending);
+                    trees.push(std::move(result));
+                }
+            }
+            deleteTokens(batch.tokens);
+            if (batch.endOfFile) {
+                if (failed || !pending.empty() || depth != 0) {
+                    trees.push(ClassTree{NULL, true, ""});
+                }
+                deleteTokens(pending);
+                file++;
+                depth = 0;
+                failed = false;
+            }
+        }
+        trees.close();
+    });
+
+    ClassTree result;
+    while (trees.pop(result)) {
+        if (result.failed) {
+            stats.failed++;
+            continue;
+        }
+        // A tree too big to print counts as failed; the queue is still
+        // drained so the other stages can finish
+        bool printed = false;
+        try {
+            out << result.tree->tostring();
+            printed = true;
+        } catch (MemoryBudgetException& e) {
+        } catch (bad_alloc& e) {
+        }
+        if (foldReport != NULL) {
+            *foldReport << result.foldReport;
+        }
+        delete result.tree;
+        if (printed) {
+            stats.classes++;
+        } else {
+            stats.failed++;
+        }
+    }
+
+    reader.join();
+    tokenizer.join();
+    parser.join();
+    stats.files = files.size();
+    return stats;
+}
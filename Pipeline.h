@@ -0,0 +1,64 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <cstddef>
+#include <list>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ParseTree.h"
+#include "Token.h"
+
+/**
+ * Parses source files with reading, tokenizing, parsing and output writing
+ * running as separate stages on their own threads. Stages are connected by
+ * bounded queues of source chunks, token batches and finished class trees,
+ * so a slow stage holds back the ones before it. The reading stage loads
+ * files in batches through a FileLoader.
+ */
+class Pipeline {
+    public:
+        struct Stats {
+            int files;
+            int classes;
+            int failed;
+        };
+
+        Pipeline(std::size_t chunkSize, std::size_t queueCapacity);
+
+        void setIterative(bool iterative);
+        void setFold(bool fold, std::ostream* report);
+
+        Stats run(const std::vector<std::string>& files, std::ostream& out);
+
+    private:
+        // Files in flight at once when loading sources
+        static const int LOAD_BATCH = 64;
+
+        struct Chunk {
+            std::string text;
+            bool endOfFile;
+            bool failed;
+        };
+
+        struct TokenBatch {
+            std::list<Token*> tokens;
+            bool endOfFile;
+            bool failed;
+        };
+
+        struct ClassTree {
+            ParseTree* tree;
+            bool failed;
+            std::string foldReport;
+        };
+
+        std::size_t chunkSize;
+        std::size_t queueCapacity;
+        bool iterative;
+        bool fold;
+        std::ostream* foldReport;
+};
+
+#endif /*PIPELINE_H*/
@@ -0,0 +1,520 @@
+#include "ProjectIndex.h"
+#include "CompilerParser.h"
+#include "FileLoader.h"
+#include "FileUtil.h"
+#include "MemoryStats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char INDEX_MAGIC[4] = {'J', 'I', 'D', 'X'};
+static const uint32_t INDEX_VERSION = 1;
+
+/*
+ * On-disk layout: a Header followed by the file, class, subroutine and
+ * field record arrays and finally a table of NUL-terminated strings.
+ * Strings are referred to by their offset into the table. Class records
+ * are sorted by name, subroutine records by name then class, and field
+ * records by class in declaration order, so every lookup is a binary search.
+ */
+struct ProjectIndex::Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t fileCount;
+    uint32_t classCount;
+    uint32_t subroutineCount;
+    uint32_t fieldCount;
+    uint32_t stringBytes;
+    uint32_t reserved;
+};
+
+struct ProjectIndex::FileRecord {
+    uint64_t size;
+    int64_t mtime;
+    uint32_t path;
+    uint32_t ok;
+};
+
+struct ProjectIndex::ClassRecord {
+    uint32_t name;
+    uint32_t file;
+};
+
+struct ProjectIndex::SubroutineRecord {
+    uint32_t name;
+    uint32_t className;
+    uint32_t kind;
+    uint32_t returnType;
+    uint32_t file;
+};
+
+struct ProjectIndex::FieldRecord {
+    uint32_t className;
+    uint32_t name;
+    uint32_t kind;
+    uint32_t type;
+    uint32_t file;
+};
+
+/**
+ * Constructor for the ProjectIndex. The index is empty until open() or build() is called.
+ */
+ProjectIndex::ProjectIndex() {
+    data = NULL;
+    length = 0;
+}
+
+ProjectIndex::~ProjectIndex() {
+    close();
+}
+
+/**
+ * Memory-map an index file written by build()
+ * @param path The index file
+ * @return true if the index was opened, false if it is missing or invalid
+ */
+bool ProjectIndex::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    data = (const char*) mapping;
+    length = info.st_size;
+
+    const Header* h = header();
+    size_t expected = sizeof(Header)
+        + h->fileCount * sizeof(FileRecord)
+        + h->classCount * sizeof(ClassRecord)
+        + h->subroutineCount * sizeof(SubroutineRecord)
+        + h->fieldCount * sizeof(FieldRecord)
+        + h->stringBytes;
+    if (memcmp(h->magic, INDEX_MAGIC, 4) != 0 || h->version != INDEX_VERSION || expected != length || !validate()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Check that every record refers to a file in the index and to a string
+ * inside the string table, and that the last string is terminated, so
+ * lookups never read outside the mapping
+ * @return true if the index is consistent, false otherwise
+ */
+bool ProjectIndex::validate() {
+    const Header* h = header();
+    uint32_t strings = h->stringBytes;
+    if (strings > 0 && text(0)[strings - 1] != '\0') {
+        return false;
+    }
+    for (uint32_t i = 0; i < h->fileCount; i++) {
+        if (fileRecords()[i].path >= strings) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h->classCount; i++) {
+        const ClassRecord& r = classRecords()[i];
+        if (r.name >= strings || r.file >= h->fileCount) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h->subroutineCount; i++) {
+        const SubroutineRecord& r = subroutineRecords()[i];
+        if (r.name >= strings || r.className >= strings || r.kind >= strings || r.returnType >= strings
+                || r.file >= h->fileCount) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h->fieldCount; i++) {
+        const FieldRecord& r = fieldRecords()[i];
+        if (r.className >= strings || r.name >= strings || r.kind >= strings || r.type >= strings
+                || r.file >= h->fileCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Unmap the index file, leaving the index empty
+ */
+void ProjectIndex::close() {
+    if (data != NULL) {
+        munmap((void*) data, length);
+    }
+    data = NULL;
+    length = 0;
+}
+
+const ProjectIndex::Header* ProjectIndex::header() {
+    return (const Header*) data;
+}
+
+const ProjectIndex::FileRecord* ProjectIndex::fileRecords() {
+    return (const FileRecord*) (data + sizeof(Header));
+}
+
+const ProjectIndex::ClassRecord* ProjectIndex::classRecords() {
+    return (const ClassRecord*) (fileRecords() + header()->fileCount);
+}
+
+const ProjectIndex::SubroutineRecord* ProjectIndex::subroutineRecords() {
+    return (const SubroutineRecord*) (classRecords() + header()->classCount);
+}
+
+const ProjectIndex::FieldRecord* ProjectIndex::fieldRecords() {
+    return (const FieldRecord*) (subroutineRecords() + header()->subroutineCount);
+}
+
+const char* ProjectIndex::text(uint32_t offset) {
+    return (const char*) (fieldRecords() + header()->fieldCount) + offset;
+}
+
+/**
+ * Get the number of files in the index
+ * @return The file count
+ */
+size_t ProjectIndex::getFileCount() {
+    return data == NULL ? 0 : header()->fileCount;
+}
+
+/**
+ * Find every class that declares a subroutine
+ * @param name The subroutine name
+ * @return The matching subroutines, ordered by class name
+ */
+vector<ProjectIndex::Subroutine> ProjectIndex::findSubroutine(const std::string& name) {
+    vector<Subroutine> result;
+    if (data == NULL) {
+        return result;
+    }
+    const SubroutineRecord* begin = subroutineRecords();
+    const SubroutineRecord* end = begin + header()->subroutineCount;
+    const SubroutineRecord* it = lower_bound(begin, end, name.c_str(), [this](const SubroutineRecord& r, const char* key) {
+        return strcmp(text(r.name), key) < 0;
+    });
+    for (; it != end && name == text(it->name); it++) {
+        Subroutine s;
+        s.className = text(it->className);
+        s.kind = text(it->kind);
+        s.returnType = text(it->returnType);
+        s.name = text(it->name);
+        s.file = text(fileRecords()[it->file].path);
+        result.push_back(s);
+    }
+    return result;
+}
+
+/**
+ * Get the static and field variables declared by a class
+ * @param className The class name
+ * @return The class's variables in declaration order
+ */
+vector<ProjectIndex::Field> ProjectIndex::getFields(const std::string& className) {
+    vector<Field> result;
+    if (data == NULL) {
+        return result;
+    }
+    const FieldRecord* begin = fieldRecords();
+    const FieldRecord* end = begin + header()->fieldCount;
+    const FieldRecord* it = lower_bound(begin, end, className.c_str(), [this](const FieldRecord& r, const char* key) {
+        return strcmp(text(r.className), key) < 0;
+    });
+    for (; it != end && className == text(it->className); it++) {
+        Field f;
+        f.className = text(it->className);
+        f.kind = text(it->kind);
+        f.type = text(it->type);
+        f.name = text(it->name);
+        f.file = text(fileRecords()[it->file].path);
+        result.push_back(f);
+    }
+    return result;
+}
+
+/**
+ * Find the file that declares a class
+ * @param className The class name
+ * @return The file's path, or an empty string if the class is not indexed
+ */
+std::string ProjectIndex::findClassFile(const std::string& className) {
+    if (data == NULL) {
+        return "";
+    }
+    const ClassRecord* begin = classRecords();
+    const ClassRecord* end = begin + header()->classCount;
+    const ClassRecord* it = lower_bound(begin, end, className.c_str(), [this](const ClassRecord& r, const char* key) {
+        return strcmp(text(r.name), key) < 0;
+    });
+    if (it == end || className != text(it->name)) {
+        return "";
+    }
+    return text(fileRecords()[it->file].path);
+}
+
+/**
+ * Collect the class name, subroutine signatures and class variables from a class parse tree
+ * @param tree A tree produced by CompilerParser::compileClass()
+ * @param symbols The symbols to add to
+ */
+void ProjectIndex::collectSymbols(ParseTree* tree, FileSymbols& symbols) {
+    list<ParseTree*> children = tree->getChildren();
+    list<ParseTree*>::iterator it = children.begin();
+    if (children.size() < 2) {
+        return;
+    }
+    symbols.className = (*++it)->getValue();
+
+    for (ParseTree* child : children) {
+        if (child->getType() == "classVarDec") {
+            list<ParseTree*> parts = child->getChildren();
+            list<ParseTree*>::iterator part = parts.begin();
+            Field f;
+            f.className = symbols.className;
+            f.kind = (*part++)->getValue();
+            f.type = (*part++)->getValue();
+            f.file = symbols.path;
+            for (; part != parts.end(); part++) {
+                if ((*part)->getType() == "identifier") {
+                    f.name = (*part)->getValue();
+                    symbols.fields.push_back(f);
+                }
+            }
+        } else if (child->getType() == "Subroutine") {
+            list<ParseTree*> parts = child->getChildren();
+            list<ParseTree*>::iterator part = parts.begin();
+            Subroutine s;
+            s.className = symbols.className;
+            s.kind = (*part++)->getValue();
+            s.returnType = (*part++)->getValue();
+            s.name = (*part)->getValue();
+            s.file = symbols.path;
+            symbols.subroutines.push_back(s);
+        }
+    }
+}
+
+/**
+ * Tokenize and parse a file, filling in its symbols. Files that cannot be
+ * parsed are marked as not ok.
+ * @param symbols The symbols to fill in; path, size and mtime must already be set
+ * @param source The file's contents
+ */
+void ProjectIndex::parseFile(FileSymbols& symbols, const std::string& source) {
+    symbols.ok = false;
+    ParseTree* tree = NULL;
+    try {
+        tree = CompilerParser::parseClass(source, false, NULL);
+        collectSymbols(tree, symbols);
+        symbols.ok = true;
+    } catch (ParseException& e) {
+    } catch (MemoryBudgetException& e) {
+    }
+    delete tree;
+}
+
+/**
+ * Read every file's symbols back out of the mapped index
+ * @param files Set to one entry per indexed file
+ */
+void ProjectIndex::load(vector<FileSymbols>& files) {
+    files.clear();
+    if (data == NULL) {
+        return;
+    }
+    const Header* h = header();
+    files.resize(h->fileCount);
+    for (uint32_t i = 0; i < h->fileCount; i++) {
+        const FileRecord& r = fileRecords()[i];
+        files[i].path = text(r.path);
+        files[i].size = r.size;
+        files[i].mtime = r.mtime;
+        files[i].ok = r.ok != 0;
+    }
+    for (uint32_t i = 0; i < h->classCount; i++) {
+        files[classRecords()[i].file].className = text(classRecords()[i].name);
+    }
+    for (uint32_t i = 0; i < h->subroutineCount; i++) {
+        const SubroutineRecord& r = subroutineRecords()[i];
+        FileSymbols& owner = files[r.file];
+        Subroutine s;
+        s.className = text(r.className);
+        s.kind = text(r.kind);
+        s.returnType = text(r.returnType);
+        s.name = text(r.name);
+        s.file = owner.path;
+        owner.subroutines.push_back(s);
+    }
+    for (uint32_t i = 0; i < h->fieldCount; i++) {
+        const FieldRecord& r = fieldRecords()[i];
+        FileSymbols& owner = files[r.file];
+        Field f;
+        f.className = text(r.className);
+        f.kind = text(r.kind);
+        f.type = text(r.type);
+        f.name = text(r.name);
+        f.file = owner.path;
+        owner.fields.push_back(f);
+    }
+}
+
+/**
+ * Build the index for a set of files and open it. Files already in the index
+ * at that path with an unchanged size and modification time are reused;
+ * the rest are loaded in batches by a FileLoader and parsed in parallel as
+ * they arrive.
+ * @param files The source files in the project
+ * @param path The index file to write
+ * @param threads The number of parser threads, or 0 to use one per core
+ * @return How many files were parsed, reused, and failed to parse
+ */
+ProjectIndex::BuildStats ProjectIndex::build(const vector<std::string>& files, const std::string& path, int threads) {
+    BuildStats stats = {0, 0, 0};
+
+    vector<FileSymbols> previous;
+    if (open(path)) {
+        load(previous);
+    }
+    map<std::string, size_t> previousByPath;
+    for (size_t i = 0; i < previous.size(); i++) {
+        previousByPath[previous[i].path] = i;
+    }
+
+    vector<FileSymbols> current(files.size());
+    vector<size_t> changed;
+    for (size_t i = 0; i < files.size(); i++) {
+        FileStamp stamp = {0, 0};
+        FileUtil::stat(files[i], stamp);
+        map<std::string, size_t>::iterator old = previousByPath.find(files[i]);
+        if (old != previousByPath.end() && previous[old->second].size == stamp.size && previous[old->second].mtime == stamp.mtime) {
+            current[i] = previous[old->second];
+            stats.reused++;
+        } else {
+            current[i].path = files[i];
+            current[i].size = stamp.size;
+            current[i].mtime = stamp.mtime;
+            changed.push_back(i);
+        }
+    }
+    previous.clear();
+
+    // Changed files are read in batches, and each is parsed on a worker
+    // thread as soon as it has been read. Files that cannot be read are
+    // marked as not ok.
+    vector<std::string> changedPaths;
+    for (size_t i : changed) {
+        changedPaths.push_back(files[i]);
+    }
+    FileLoader loader(LOAD_BATCH, threads);
+    loader.loadAndProcess(changedPaths, [&](size_t i, std::string& contents, bool ok) {
+        if (ok) {
+            parseFile(current[changed[i]], contents);
+        } else {
+            current[changed[i]].ok = false;
+        }
+    });
+    for (size_t i : changed) {
+        stats.parsed++;
+        if (!current[i].ok) {
+            stats.failed++;
+        }
+    }
+
+    close();
+    if (write(path, current)) {
+        open(path);
+    }
+    return stats;
+}
+
+/**
+ * Write an index file
+ * @param path The index file to write
+ * @param files The symbols of every file in the project
+ * @return true if the file was written, false otherwise
+ */
+bool ProjectIndex::write(const std::string& path, const vector<FileSymbols>& files) {
+    std::string strings;
+    map<std::string, uint32_t> offsets;
+    auto intern = [&](const std::string& s) {
+        map<std::string, uint32_t>::iterator it = offsets.find(s);
+        if (it != offsets.end()) {
+            return it->second;
+        }
+        uint32_t offset = strings.size();
+        strings += s;
+        strings += '\0';
+        offsets[s] = offset;
+        return offset;
+    };
+
+    vector<FileRecord> fileTable;
+    vector<pair<std::string, ClassRecord> > classTable;
+    vector<pair<std::string, SubroutineRecord> > subroutineTable;
+    vector<pair<std::string, FieldRecord> > fieldTable;
+    for (uint32_t i = 0; i < files.size(); i++) {
+        const FileSymbols& f = files[i];
+        FileRecord r = {f.size, f.mtime, intern(f.path), f.ok ? 1u : 0u};
+        fileTable.push_back(r);
+        if (!f.className.empty()) {
+            ClassRecord c = {intern(f.className), i};
+            classTable.push_back(make_pair(f.className, c));
+        }
+        for (const Subroutine& s : f.subroutines) {
+            SubroutineRecord r = {intern(s.name), intern(s.className), intern(s.kind), intern(s.returnType), i};
+            subroutineTable.push_back(make_pair(s.name + '\0' + s.className, r));
+        }
+        for (const Field& v : f.fields) {
+            FieldRecord r = {intern(v.className), intern(v.name), intern(v.kind), intern(v.type), i};
+            fieldTable.push_back(make_pair(v.className, r));
+        }
+    }
+    auto byKey = [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    };
+    sort(classTable.begin(), classTable.end(), byKey);
+    sort(subroutineTable.begin(), subroutineTable.end(), byKey);
+    stable_sort(fieldTable.begin(), fieldTable.end(), byKey);
+
+    Header h;
+    memcpy(h.magic, INDEX_MAGIC, 4);
+    h.version = INDEX_VERSION;
+    h.fileCount = fileTable.size();
+    h.classCount = classTable.size();
+    h.subroutineCount = subroutineTable.size();
+    h.fieldCount = fieldTable.size();
+    h.stringBytes = strings.size();
+    h.reserved = 0;
+
+    std::string contents((const char*) &h, sizeof(h));
+    contents.append((const char*) fileTable.data(), fileTable.size() * sizeof(FileRecord));
+    for (const auto& c : classTable) {
+        contents.append((const char*) &c.second, sizeof(ClassRecord));
+    }
+    for (const auto& s : subroutineTable) {
+        contents.append((const char*) &s.second, sizeof(SubroutineRecord));
+    }
+    for (const auto& v : fieldTable) {
+        contents.append((const char*) &v.second, sizeof(FieldRecord));
+    }
+    contents += strings;
+    return FileUtil::writeFile(path, contents);
+}
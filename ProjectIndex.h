@@ -0,0 +1,93 @@
+#ifndef PROJECTINDEX_H
+#define PROJECTINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ParseTree.h"
+
+/**
+ * Cross-file index of the classes, subroutines and fields in a project.
+ * The index is built from the class-level nodes of each file's parse tree,
+ * stored on disk in a sorted binary format and memory-mapped for lookups.
+ * Rebuilding reuses the entries of files whose size and modification time
+ * have not changed.
+ */
+class ProjectIndex {
+    public:
+        struct Subroutine {
+            std::string className;
+            std::string kind;
+            std::string returnType;
+            std::string name;
+            std::string file;
+        };
+
+        struct Field {
+            std::string className;
+            std::string kind;
+            std::string type;
+            std::string name;
+            std::string file;
+        };
+
+        struct BuildStats {
+            int parsed;
+            int reused;
+            int failed;
+        };
+
+        /** The symbols declared by one source file */
+        struct FileSymbols {
+            std::string path;
+            uint64_t size;
+            int64_t mtime;
+            bool ok;
+            std::string className;
+            std::vector<Subroutine> subroutines;
+            std::vector<Field> fields;
+        };
+
+        ProjectIndex();
+        ~ProjectIndex();
+
+        bool open(const std::string& path);
+        void close();
+        BuildStats build(const std::vector<std::string>& files, const std::string& path, int threads);
+
+        std::vector<Subroutine> findSubroutine(const std::string& name);
+        std::vector<Field> getFields(const std::string& className);
+        std::string findClassFile(const std::string& className);
+        std::size_t getFileCount();
+
+        static void collectSymbols(ParseTree* tree, FileSymbols& symbols);
+
+    private:
+        // Files in flight at once when loading sources
+        static const int LOAD_BATCH = 64;
+
+        struct Header;
+        struct FileRecord;
+        struct ClassRecord;
+        struct SubroutineRecord;
+        struct FieldRecord;
+
+        const char* data;
+        std::size_t length;
+
+        const Header* header();
+        const FileRecord* fileRecords();
+        const ClassRecord* classRecords();
+        const SubroutineRecord* subroutineRecords();
+        const FieldRecord* fieldRecords();
+        const char* text(uint32_t offset);
+        bool validate();
+
+        void load(std::vector<FileSymbols>& files);
+        static void parseFile(FileSymbols& symbols, const std::string& source);
+        static bool write(const std::string& path, const std::vector<FileSymbols>& files);
+};
+
+#endif /*PROJECTINDEX_H*/
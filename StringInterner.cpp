@@ -0,0 +1,270 @@
+#include "StringInterner.h"
+#include "FileUtil.h"
+#include "MemoryStats.h"
+
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * Get the request counter shard for the calling thread
+ * @return The shard index
+ */
+static int counterShard() {
+    static atomic<int> nextShard(0);
+    thread_local int shard = nextShard++;
+    return shard;
+}
+
+/**
+ * Constructor for the StringInterner
+ * @param initialCapacity The number of slots in the first level, rounded up to a power of two
+ */
+StringInterner::StringInterner(size_t initialCapacity) : uniqueCount(0), storedBytes(0) {
+    size_t size = 1;
+    while (size < initialCapacity) {
+        size *= 2;
+    }
+    StringInterner::initialCapacity = size;
+    for (int i = 0; i < MAX_LEVELS; i++) {
+        levels[i].store(NULL, memory_order_relaxed);
+    }
+    for (int i = 0; i < COUNTER_SHARDS; i++) {
+        counters[i].requests.store(0, memory_order_relaxed);
+        counters[i].bytes.store(0, memory_order_relaxed);
+    }
+}
+
+/**
+ * Deletes the table and every string in it. No other thread may be using it.
+ */
+StringInterner::~StringInterner() {
+    for (int l = 0; l < MAX_LEVELS; l++) {
+        Level* current = levels[l].load(memory_order_relaxed);
+        if (current == NULL) {
+            continue;
+        }
+        for (size_t i = 0; i <= current->mask; i++) {
+            Entry* e = current->slots[i].load(memory_order_relaxed);
+            if (e != NULL && e != moved()) {
+                MemoryStats::release(MemoryStats::STRINGS, sizeof(Entry) + MemoryStats::heapBytes(e->text));
+                delete e;
+            }
+        }
+        MemoryStats::release(MemoryStats::STRINGS, (current->mask + 1) * sizeof(atomic<Entry*>));
+        delete[] current->slots;
+        delete current;
+    }
+}
+
+/**
+ * Marker left in an empty slot of a half-full level. A probe that reaches it
+ * continues in the next level, as does any later probe for the same string.
+ * @return The marker
+ */
+StringInterner::Entry* StringInterner::moved() {
+    static Entry marker = {0, ""};
+    return &marker;
+}
+
+/**
+ * Get a level of the table, creating it if no thread has yet
+ * @param index The level, 0 being the smallest
+ * @return The level
+ */
+StringInterner::Level* StringInterner::level(int index) {
+    Level* current = levels[index].load(memory_order_acquire);
+    if (current != NULL) {
+        return current;
+    }
+    size_t size = initialCapacity << index;
+    MemoryStats::allocate(MemoryStats::STRINGS, size * sizeof(atomic<Entry*>));
+    Level* created = new Level;
+    created->mask = size - 1;
+    created->count.store(0, memory_order_relaxed);
+    created->slots = new atomic<Entry*>[size];
+    for (size_t i = 0; i < size; i++) {
+        created->slots[i].store(NULL, memory_order_relaxed);
+    }
+    if (levels[index].compare_exchange_strong(current, created, memory_order_acq_rel, memory_order_acquire)) {
+        return created;
+    }
+    // Another thread created the level first
+    MemoryStats::release(MemoryStats::STRINGS, size * sizeof(atomic<Entry*>));
+    delete[] created->slots;
+    delete created;
+    return current;
+}
+
+/**
+ * Get the ID of a string, adding it to the table if it is not there yet.
+ * Safe to call from any number of threads at once.
+ * @param s The string
+ * @return The string's ID
+ */
+uint32_t StringInterner::intern(const string& s) {
+    Counter& counter = counters[counterShard() % COUNTER_SHARDS];
+    counter.requests.fetch_add(1, memory_order_relaxed);
+    counter.bytes.fetch_add(s.size(), memory_order_relaxed);
+
+    uint64_t hash = FileUtil::hash(s);
+    Entry* candidate = NULL;
+    size_t candidateBytes = 0;
+    for (int l = 0; l < MAX_LEVELS; l++) {
+        Level* current = level(l);
+        size_t i = hash & current->mask;
+        while (true) {
+            Entry* e = current->slots[i].load(memory_order_acquire);
+            if (e == NULL) {
+                bool full = current->count.load(memory_order_relaxed) * 2 > current->mask;
+                if (full) {
+                    if (current->slots[i].compare_exchange_strong(e, moved(), memory_order_acq_rel, memory_order_acquire)) {
+                        break;
+                    }
+                } else {
+                    if (candidate == NULL) {
+                        candidate = new Entry{hash, s};
+                        candidateBytes = sizeof(Entry) + MemoryStats::heapBytes(candidate->text);
+                        try {
+                            MemoryStats::allocate(MemoryStats::STRINGS, candidateBytes);
+                        } catch (...) {
+                            delete candidate;
+                            throw;
+                        }
+                    }
+                    if (current->slots[i].compare_exchange_strong(e, candidate, memory_order_acq_rel, memory_order_acquire)) {
+                        current->count.fetch_add(1, memory_order_relaxed);
+                        uniqueCount.fetch_add(1, memory_order_relaxed);
+                        storedBytes.fetch_add(s.size(), memory_order_relaxed);
+                        return ((uint32_t) l << SLOT_BITS) | (uint32_t) i;
+                    }
+                }
+                // Another thread filled the slot first; e now holds what it wrote
+            }
+            if (e == moved()) {
+                break;
+            }
+            if (e->hash == hash && e->text == s) {
+                if (candidate != NULL) {
+                    MemoryStats::release(MemoryStats::STRINGS, candidateBytes);
+                    delete candidate;
+                }
+                return ((uint32_t) l << SLOT_BITS) | (uint32_t) i;
+            }
+            i = (i + 1) & current->mask;
+        }
+    }
+    if (candidate != NULL) {
+        MemoryStats::release(MemoryStats::STRINGS, candidateBytes);
+        delete candidate;
+    }
+    throw length_error("string interner is full");
+}
+
+/**
+ * Get the string with an ID returned by intern()
+ * @param id The string's ID
+ * @return The string
+ */
+const string& StringInterner::text(uint32_t id) {
+    Level* current = levels[id >> SLOT_BITS].load(memory_order_acquire);
+    return current->slots[id & ((1u << SLOT_BITS) - 1)].load(memory_order_acquire)->text;
+}
+
+/**
+ * Get the shared copy of a string, adding it to the table if needed
+ * @param s The string
+ * @return A reference to the copy in the table, valid for the table's life
+ */
+const string& StringInterner::canonical(const string& s) {
+    return text(intern(s));
+}
+
+/**
+ * Get the number of slots across all levels created so far
+ * @return The capacity
+ */
+size_t StringInterner::getCapacity() {
+    size_t total = 0;
+    for (int l = 0; l < MAX_LEVELS; l++) {
+        Level* current = levels[l].load(memory_order_acquire);
+        if (current != NULL) {
+            total += current->mask + 1;
+        }
+    }
+    return total;
+}
+
+/**
+ * Get the number of unique strings in the table
+ * @return The string count
+ */
+size_t StringInterner::getUniqueCount() {
+    return uniqueCount.load(memory_order_relaxed);
+}
+
+/**
+ * Get the number of characters stored across all unique strings
+ * @return The character count
+ */
+size_t StringInterner::getStoredBytes() {
+    return storedBytes.load(memory_order_relaxed);
+}
+
+/**
+ * Get the number of calls to intern()
+ * @return The call count
+ */
+size_t StringInterner::getRequests() {
+    size_t total = 0;
+    for (int i = 0; i < COUNTER_SHARDS; i++) {
+        total += counters[i].requests.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * Get the number of characters passed to intern(), which is what separate
+ * copies of every string would have held
+ * @return The character count
+ */
+size_t StringInterner::getRequestedBytes() {
+    size_t total = 0;
+    for (int i = 0; i < COUNTER_SHARDS; i++) {
+        total += counters[i].bytes.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * Generate a report of how much the table has deduplicated. Separate copies
+ * are counted as one std::string object plus its characters per request.
+ * @return A printable summary
+ */
+string StringInterner::report() {
+    size_t requests = getRequests();
+    size_t separate = getRequestedBytes() + requests * sizeof(string);
+    size_t interned = getStoredBytes() + getUniqueCount() * sizeof(Entry)
+        + getCapacity() * sizeof(atomic<Entry*>) + requests * sizeof(const string*);
+    ostringstream out;
+    out << "string interner\n"
+        << "  " << requests << " requests, " << getUniqueCount() << " unique strings, "
+        << getCapacity() << " slots\n"
+        << "  " << separate << " bytes as separate copies, " << interned << " bytes interned, "
+        << (separate > interned ? separate - interned : 0) << " bytes saved\n";
+    return out.str();
+}
+
+/**
+ * Get the table shared by every ParseTree and Token. It is never deleted,
+ * so its strings stay valid until the process exits, and it never shrinks:
+ * it grows with every distinct identifier and constant the process sees,
+ * across all sessions. Its bytes are reported under MemoryStats::STRINGS,
+ * which is left out of the per-session budget.
+ * @return The shared table
+ */
+StringInterner& StringInterner::global() {
+    static StringInterner* instance = new StringInterner(4096);
+    return *instance;
+}
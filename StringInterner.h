@@ -0,0 +1,68 @@
+#ifndef STRINGINTERNER_H
+#define STRINGINTERNER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Concurrent table of unique strings shared by parser threads.
+ * Lookup and insert are lock-free: each level of the table is open-addressed
+ * with one atomic pointer per slot, and a new string is published with a
+ * single compare-and-swap. When a level is half full, new strings go to the
+ * next level, which is twice as large, so nothing is ever moved. A string's
+ * ID is its level and slot, so IDs and the strings they name stay valid for
+ * the life of the table.
+ */
+class StringInterner {
+    public:
+        StringInterner(std::size_t initialCapacity);
+        ~StringInterner();
+
+        uint32_t intern(const std::string& s);
+        const std::string& text(uint32_t id);
+        const std::string& canonical(const std::string& s);
+
+        std::size_t getCapacity();
+        std::size_t getUniqueCount();
+        std::size_t getStoredBytes();
+        std::size_t getRequests();
+        std::size_t getRequestedBytes();
+        std::string report();
+
+        static StringInterner& global();
+
+    private:
+        struct Entry {
+            uint64_t hash;
+            std::string text;
+        };
+
+        struct Level {
+            std::size_t mask;
+            std::atomic<std::size_t> count;
+            std::atomic<Entry*>* slots;
+        };
+
+        static const int MAX_LEVELS = 16;
+        static const int SLOT_BITS = 27;
+
+        // Request counters are spread over cache lines to avoid contention
+        struct alignas(64) Counter {
+            std::atomic<std::size_t> requests;
+            std::atomic<std::size_t> bytes;
+        };
+        static const int COUNTER_SHARDS = 16;
+
+        std::size_t initialCapacity;
+        std::atomic<Level*> levels[MAX_LEVELS];
+        std::atomic<std::size_t> uniqueCount;
+        std::atomic<std::size_t> storedBytes;
+        Counter counters[COUNTER_SHARDS];
+
+        Level* level(int index);
+        static Entry* moved();
+};
+
+#endif /*STRINGINTERNER_H*/
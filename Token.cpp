@@ -1,4 +1,6 @@
 #include "Token.h"
+#include "MemoryStats.h"
+
 using namespace std;
 
 /**
@@ -7,4 +9,23 @@ using namespace std;
  * @param value The token's value. Can be read using token.getValue()
  */
 Token::Token(string type, string value) : ParseTree(type, value) {
+}
+
+/**
+ * Allocates memory for a Token, counted as a token
+ * @param size The number of bytes to allocate
+ */
+void* Token::operator new(size_t size) {
+    MemoryStats::allocate(MemoryStats::TOKENS, size);
+    return ::operator new(size);
+}
+
+/**
+ * Frees memory for a Token
+ * @param p The token to free
+ * @param size The number of bytes allocated for the token
+ */
+void Token::operator delete(void* p, size_t size) {
+    MemoryStats::release(MemoryStats::TOKENS, size);
+    ::operator delete(p);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <cstddef>
 #include <string>
 
 #include "ParseTree.h"
@@ -8,6 +9,10 @@
 class Token : public ParseTree {
     public:
         Token(std::string type, std::string value);
+
+        static void* operator new(std::size_t size);
+
+        static void operator delete(void* p, std::size_t size);
 };
 
 #endif /*TOKEN_H*/
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include "Tokenizer.h"
+#include "CompilerParser.h"
+
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+static const char* SYMBOLS = "{}()[].,;+-*/&|<>=~";
+
+static const char* KEYWORDS[] = {
+    "class", "constructor", "function", "method", "field", "static", "var",
+    "int", "char", "boolean", "void", "true", "false", "null", "this",
+    "let", "do", "if", "else", "while", "return", "skip"
+};
+
+/**
+ * Constructor for the Tokenizer
+ */
+Tokenizer::Tokenizer() {
+}
+
+/**
+ * Tokenize the next chunk of source text. Tokens that may continue into the
+ * next chunk are held back until feed() or finish() is called again.
+ * @param chunk The source text to add
+ * @param out The list complete tokens are appended to
+ */
+void Tokenizer::feed(const string& chunk, list<Token*>& out) {
+    pending += chunk;
+    scan(pending, false, out);
+}
+
+/**
+ * Tokenize any source text held back by feed(). Throws a ParseException if
+ * the source ends inside a comment or string.
+ * @param out The list the remaining tokens are appended to
+ */
+void Tokenizer::finish(list<Token*>& out) {
+    scan(pending, true, out);
+    pending.clear();
+}
+
+/**
+ * Tokenize a complete source file. If the source cannot be tokenized, no
+ * tokens are leaked when the ParseException propagates.
+ * @param source The Jack source text
+ * @return A linked list of tokens
+ */
+list<Token*> Tokenizer::tokenize(const string& source) {
+    Tokenizer tokenizer;
+    list<Token*> tokens;
+    tokenizer.feed(source, tokens);
+    try {
+        tokenizer.finish(tokens);
+    } catch (...) {
+        for (Token* token : tokens) {
+            delete token;
+        }
+        throw;
+    }
+    return tokens;
+}
+
+/**
+ * Check if a word is a reserved keyword
+ * @return true if a keyword, false otherwise
+ */
+bool Tokenizer::isKeyword(const string& word) {
+    for (const char* keyword : KEYWORDS) {
+        if (word == keyword) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Scan as many complete tokens as possible from the source text, keeping
+ * the unscanned remainder in pending. If the text cannot be tokenized, the
+ * tokens scanned so far are deleted before the ParseException propagates,
+ * and out is left as it was.
+ * @param source The text to scan
+ * @param final true if no more text will follow
+ * @param out The list tokens are appended to
+ */
+void Tokenizer::scan(const string& source, bool final, list<Token*>& out) {
+    list<Token*> scanned;
+    try {
+        scanTokens(source, final, scanned);
+    } catch (...) {
+        for (Token* token : scanned) {
+            delete token;
+        }
+        throw;
+    }
+    out.splice(out.end(), scanned);
+}
+
+/**
+ * Scan tokens for scan(), which owns the list they are appended to
+ * @param source The text to scan
+ * @param final true if no more text will follow
+ * @param out The list tokens are appended to
+ */
+void Tokenizer::scanTokens(const string& source, bool final, list<Token*>& out) {
+    size_t length = source.size();
+    size_t pos = 0;
+    while (pos < length) {
+        char c = source[pos];
+        size_t start = pos;
+
+        if (isspace((unsigned char) c)) {
+            pos++;
+            continue;
+        }
+
+        if (c == '/' && pos + 1 >= length && !final) {
+            // May be the start of a comment
+            break;
+        }
+        if (c == '/' && source[pos + 1] == '/') {
+            size_t end = source.find('\n', pos + 2);
+            if (end == string::npos) {
+                if (!final) {
+                    break;
+                }
+                end = length;
+            }
+            pos = end;
+            continue;
+        }
+        if (c == '/' && source[pos + 1] == '*') {
+            size_t end = source.find("*/", pos + 2);
+            if (end == string::npos) {
+                if (!final) {
+                    break;
+                }
+                throw ParseException();
+            }
+            pos = end + 2;
+            continue;
+        }
+
+        if (strchr(SYMBOLS, c) != NULL) {
+            out.push_back(new Token("symbol", string(1, c)));
+            pos++;
+        } else if (c == '"') {
+            size_t end = source.find_first_of("\"\n", pos + 1);
+            if (end == string::npos && !final) {
+                break;
+            }
+            if (end == string::npos || source[end] != '"') {
+                throw ParseException();
+            }
+            out.push_back(new Token("stringConstant", source.substr(pos + 1, end - pos - 1)));
+            pos = end + 1;
+        } else if (isdigit((unsigned char) c)) {
+            while (pos < length && isdigit((unsigned char) source[pos])) {
+                pos++;
+            }
+            if (pos == length && !final) {
+                pos = start;
+                break;
+            }
+            out.push_back(new Token("integerConstant", source.substr(start, pos - start)));
+        } else if (isalpha((unsigned char) c) || c == '_') {
+            while (pos < length && (isalnum((unsigned char) source[pos]) || source[pos] == '_')) {
+                pos++;
+            }
+            if (pos == length && !final) {
+                pos = start;
+                break;
+            }
+            string word = source.substr(start, pos - start);
+            out.push_back(new Token(isKeyword(word) ? "keyword" : "identifier", word));
+        } else {
+            throw ParseException();
+        }
+    }
+    pending = source.substr(pos);
+}
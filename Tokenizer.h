@@ -0,0 +1,31 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <list>
+#include <string>
+
+#include "Token.h"
+
+/**
+ * Splits Jack source text into Tokens for the CompilerParser.
+ * Source can be fed in arbitrary chunks; a token split across two chunks is
+ * held back until the rest of it arrives.
+ */
+class Tokenizer {
+    private:
+        std::string pending;
+
+        void scan(const std::string& source, bool final, std::list<Token*>& out);
+        void scanTokens(const std::string& source, bool final, std::list<Token*>& out);
+
+    public:
+        Tokenizer();
+
+        void feed(const std::string& chunk, std::list<Token*>& out);
+        void finish(std::list<Token*>& out);
+
+        static std::list<Token*> tokenize(const std::string& source);
+        static bool isKeyword(const std::string& word);
+};
+
+#endif /*TOKENIZER_H*/
@@ -0,0 +1,211 @@
+#include "TreeIndex.h"
+#include "StringInterner.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std;
+
+/**
+ * Constructor for the TreeIndex
+ */
+TreeIndex::TreeIndex() {
+    identifierType = &StringInterner::global().canonical("identifier");
+    nodes = 0;
+}
+
+/**
+ * Add a node to the index. Its children are not added.
+ * @param node The node
+ */
+void TreeIndex::add(ParseTree* node) {
+    byType[node->internedType()].push_back(node);
+    if (node->internedType() == identifierType) {
+        byIdentifier[node->internedValue()].push_back(node);
+    }
+    nodes++;
+    if (!cache.empty()) {
+        cache.clear();
+    }
+}
+
+/**
+ * Replace the index's contents with every node in a tree, in the order
+ * the parser builds them (each node before its children)
+ * @param root The root of the tree
+ */
+void TreeIndex::rebuild(ParseTree* root) {
+    clear();
+    vector<ParseTree*> stack;
+    stack.push_back(root);
+    while (!stack.empty()) {
+        ParseTree* node = stack.back();
+        stack.pop_back();
+        add(node);
+        size_t first = stack.size();
+        for (ParseTree::iterator it = node->childBegin(); it != node->childEnd(); it++) {
+            stack.push_back(*it);
+        }
+        reverse(stack.begin() + first, stack.end());
+    }
+}
+
+/**
+ * Remove every node from the index
+ */
+void TreeIndex::clear() {
+    byType.clear();
+    byIdentifier.clear();
+    cache.clear();
+    nodes = 0;
+}
+
+/**
+ * Get the number of nodes in the index
+ * @return The node count
+ */
+int TreeIndex::getNodeCount() {
+    return nodes;
+}
+
+/**
+ * Get every node of a type
+ * @param type The node type, such as letStatement
+ * @return The nodes, in the order they were added
+ */
+const vector<ParseTree*>& TreeIndex::ofType(const string& type) {
+    auto it = byType.find(&StringInterner::global().canonical(type));
+    return it == byType.end() ? none : it->second;
+}
+
+/**
+ * Get every identifier leaf with a name
+ * @param identifier The name
+ * @return The identifier nodes, in the order they were added
+ */
+const vector<ParseTree*>& TreeIndex::occurrences(const string& identifier) {
+    auto it = byIdentifier.find(&StringInterner::global().canonical(identifier));
+    return it == byIdentifier.end() ? none : it->second;
+}
+
+/**
+ * Find the nodes matching a path selector
+ * @param selector The selector, such as class/Subroutine[main]//letStatement
+ * @return The matching nodes, in the order they were added
+ */
+const vector<ParseTree*>& TreeIndex::select(const string& selector) {
+    auto cached = cache.find(selector);
+    if (cached != cache.end()) {
+        return cached->second;
+    }
+
+    vector<Step> steps = parse(selector);
+    const Step& last = steps.back();
+    int lastStep = steps.size() - 1;
+    vector<ParseTree*>& result = cache[selector];
+    if (last.name != NULL) {
+        // Fewer nodes have an identifier with the name than have the type
+        unordered_set<ParseTree*> seen;
+        for (ParseTree* identifier : occurrences(*last.name)) {
+            ParseTree* node = identifier->getParent();
+            if (node != NULL && node->internedType() == last.type && seen.insert(node).second
+                    && matchesUp(node, steps, lastStep)) {
+                result.push_back(node);
+            }
+        }
+    } else {
+        for (ParseTree* node : ofType(*last.type)) {
+            if (matchesUp(node, steps, lastStep)) {
+                result.push_back(node);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * Split a selector into steps. A leading / anchors the first step at the
+ * root of a tree; otherwise it may match anywhere.
+ * @param selector The selector
+ * @return The steps, first to last
+ */
+vector<TreeIndex::Step> TreeIndex::parse(const string& selector) {
+    StringInterner& strings = StringInterner::global();
+    vector<Step> steps;
+    size_t i = 0;
+    bool descendant = true;
+    if (selector.compare(0, 2, "//") == 0) {
+        i = 2;
+    } else if (selector.compare(0, 1, "/") == 0) {
+        i = 1;
+        descendant = false;
+    }
+    while (true) {
+        size_t end = selector.find('/', i);
+        string step = selector.substr(i, end == string::npos ? string::npos : end - i);
+        Step parsed = {NULL, NULL, descendant};
+        size_t open = step.find('[');
+        if (open != string::npos && step.size() > open + 2 && step.back() == ']') {
+            parsed.name = &strings.canonical(step.substr(open + 1, step.size() - open - 2));
+            step.resize(open);
+        }
+        if (step.empty() || step.find_first_of("[]") != string::npos) {
+            throw invalid_argument("invalid selector: " + selector);
+        }
+        parsed.type = &strings.canonical(step);
+        steps.push_back(parsed);
+        if (end == string::npos) {
+            return steps;
+        }
+        descendant = selector.compare(end, 2, "//") == 0;
+        i = end + (descendant ? 2 : 1);
+    }
+}
+
+/**
+ * Check whether a node has an identifier child with a name
+ * @param node The node
+ * @param name The interned name
+ * @return true if it does, false otherwise
+ */
+bool TreeIndex::hasIdentifier(ParseTree* node, const string* name) {
+    for (ParseTree::iterator it = node->childBegin(); it != node->childEnd(); it++) {
+        if ((*it)->internedType() == identifierType && (*it)->internedValue() == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Check whether a node matches one step of a selector, ignoring its position
+ * @param node The node
+ * @param step The step
+ * @return true if it matches, false otherwise
+ */
+bool TreeIndex::matches(ParseTree* node, const Step& step) {
+    return node->internedType() == step.type && (step.name == NULL || hasIdentifier(node, step.name));
+}
+
+/**
+ * Check whether the ancestors of a node match the steps before one it matches
+ * @param node A node matching steps[step]
+ * @param steps The selector's steps
+ * @param step The step the node matches
+ * @return true if the whole path up to the first step matches, false otherwise
+ */
+bool TreeIndex::matchesUp(ParseTree* node, const vector<Step>& steps, int step) {
+    if (step == 0) {
+        return steps[0].descendant || node->getParent() == NULL;
+    }
+    for (ParseTree* ancestor = node->getParent(); ancestor != NULL; ancestor = ancestor->getParent()) {
+        if (matches(ancestor, steps[step - 1]) && matchesUp(ancestor, steps, step - 1)) {
+            return true;
+        }
+        if (!steps[step].descendant) {
+            return false;
+        }
+    }
+    return false;
+}
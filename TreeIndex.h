@@ -0,0 +1,61 @@
+#ifndef TREEINDEX_H
+#define TREEINDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ParseTree.h"
+
+/**
+ * Index of the nodes in a parse tree by type, and of identifier leaves by
+ * name, for structural queries that do not walk the tree. Nodes are added
+ * as the CompilerParser builds them (see CompilerParser::setIndex()), or all
+ * at once with rebuild(). Types and names are compared by their interned
+ * addresses.
+ *
+ * Selectors are paths of node types such as
+ * class/Subroutine/subroutineBody//letStatement, where / steps to a child
+ * and // to any descendant. A step may be written type[name] to match only
+ * nodes with an identifier child called name. A selector is answered by
+ * starting from the indexed nodes of its last step and checking the rest of
+ * the path through parent links; results are cached until the index
+ * changes, so a repeated query costs only the size of its result.
+ *
+ * The index holds plain pointers: after nodes are deleted or replaced, as
+ * the ConstantFolder does, rebuild() must be called before querying again.
+ */
+class TreeIndex {
+    private:
+        struct Step {
+            const std::string* type;
+            const std::string* name;
+            bool descendant;
+        };
+
+        std::unordered_map<const std::string*, std::vector<ParseTree*>> byType;
+        std::unordered_map<const std::string*, std::vector<ParseTree*>> byIdentifier;
+        std::unordered_map<std::string, std::vector<ParseTree*>> cache;
+        std::vector<ParseTree*> none;
+        const std::string* identifierType;
+        int nodes;
+
+        static std::vector<Step> parse(const std::string& selector);
+        bool hasIdentifier(ParseTree* node, const std::string* name);
+        bool matches(ParseTree* node, const Step& step);
+        bool matchesUp(ParseTree* node, const std::vector<Step>& steps, int step);
+
+    public:
+        TreeIndex();
+
+        void add(ParseTree* node);
+        void rebuild(ParseTree* root);
+        void clear();
+
+        int getNodeCount();
+        const std::vector<ParseTree*>& ofType(const std::string& type);
+        const std::vector<ParseTree*>& occurrences(const std::string& identifier);
+        const std::vector<ParseTree*>& select(const std::string& selector);
+};
+
+#endif /*TREEINDEX_H*/
@@ -0,0 +1,255 @@
+#include "TreeRenderer.h"
+#include "MemoryStats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+// One level of indentation and the branch before each child; both are six
+// bytes, as the box-drawing characters take three bytes each in UTF-8
+static const string UNIT = "  \u2502 ";
+static const string BRANCH = "  \u2514 ";
+
+/**
+ * Constructor for the TreeRenderer
+ * @param threads The number of threads to write with, or 0 for one per core
+ */
+TreeRenderer::TreeRenderer(int threads) {
+    TreeRenderer::threads = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+    total = 0;
+    layoutBytes = 0;
+}
+
+/**
+ * Destructor for the TreeRenderer
+ */
+TreeRenderer::~TreeRenderer() {
+    MemoryStats::release(MemoryStats::OUTPUT_BUFFERS, layoutBytes);
+}
+
+/**
+ * Make room for more nodes in the layout, checking the memory budget
+ * before the vectors grow
+ * @param count The number of nodes needed
+ */
+void TreeRenderer::reserveNodes(size_t count) {
+    if (count <= nodes.capacity()) {
+        return;
+    }
+    size_t capacity = max(count, max((size_t) 1024, nodes.capacity() * 2));
+    size_t bytes = capacity * (sizeof(ParseTree*) + sizeof(int) + 3 * sizeof(size_t));
+    MemoryStats::allocate(MemoryStats::OUTPUT_BUFFERS, bytes - layoutBytes);
+    layoutBytes = bytes;
+    nodes.reserve(capacity);
+    depths.reserve(capacity);
+    ends.reserve(capacity);
+    sizes.reserve(capacity);
+    offsets.reserve(capacity);
+}
+
+/**
+ * Flatten trees into print order and work out where every byte goes.
+ * The layout is charged to the memory budget as it grows.
+ * A leaf prints as "type value\n". A node with children at depth d prints
+ * "type\n", then each child after d units of indentation and a branch, then
+ * d units of indentation and "\n", so its size is
+ * |type| + 1 + sum(6d + 6 + child) + 6d + 1.
+ * @param roots The trees, printed one after another
+ */
+void TreeRenderer::layout(const vector<ParseTree*>& roots) {
+    nodes.clear();
+    depths.clear();
+    ends.clear();
+    sizes.clear();
+
+    struct Frame {
+        size_t index;
+        ParseTree::iterator next;
+    };
+    vector<Frame> stack;
+    for (ParseTree* root : roots) {
+        ParseTree* node = root;
+        while (true) {
+            if (node != NULL) {
+                // Start a node: count its own bytes, then visit its children
+                size_t index = nodes.size();
+                reserveNodes(index + 1);
+                int depth = stack.size();
+                size_t size = node->internedType()->size() + 1;
+                if (node->childBegin() == node->childEnd()) {
+                    size += node->internedValue()->size() + 1;
+                } else {
+                    size += UNIT.size() * depth + 1;
+                }
+                nodes.push_back(node);
+                depths.push_back(depth);
+                ends.push_back(0);
+                sizes.push_back(size);
+                stack.push_back(Frame{index, node->childBegin()});
+            }
+            Frame& top = stack.back();
+            if (top.next != nodes[top.index]->childEnd()) {
+                node = *top.next++;
+                continue;
+            }
+            // Finish a node: its subtree is complete, so add it to its parent
+            size_t index = top.index;
+            ends[index] = nodes.size();
+            stack.pop_back();
+            if (stack.empty()) {
+                break;
+            }
+            size_t parent = stack.back().index;
+            sizes[parent] += UNIT.size() * depths[parent] + BRANCH.size() + sizes[index];
+            node = NULL;
+        }
+    }
+
+    offsets.assign(nodes.size(), 0);
+    total = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (depths[i] == 0) {
+            offsets[i] = total;
+            total += sizes[i];
+        }
+        size_t position = offsets[i] + nodes[i]->internedType()->size() + 1;
+        for (size_t child = i + 1; child < ends[i]; child = ends[child]) {
+            offsets[child] = position + UNIT.size() * depths[i] + BRANCH.size();
+            position = offsets[child] + sizes[child];
+        }
+    }
+}
+
+/**
+ * Write every node's own bytes into the buffer. Nodes are handed out in
+ * blocks, and no two nodes write to the same bytes.
+ * @param out The buffer, at least getSize() bytes long
+ */
+void TreeRenderer::fill(char* out) {
+    size_t maxDepth = 0;
+    for (int depth : depths) {
+        maxDepth = max(maxDepth, (size_t) depth);
+    }
+    string indent;
+    for (size_t d = 0; d < maxDepth; d++) {
+        indent += UNIT;
+    }
+    string prefix = indent + BRANCH;
+
+    const size_t block = 4096;
+    atomic<size_t> nextBlock(0);
+    auto work = [&]() {
+        for (size_t start = nextBlock.fetch_add(block); start < nodes.size(); start = nextBlock.fetch_add(block)) {
+            size_t stop = min(start + block, nodes.size());
+            for (size_t i = start; i < stop; i++) {
+                const string& type = *nodes[i]->internedType();
+                char* p = out + offsets[i];
+                memcpy(p, type.data(), type.size());
+                p += type.size();
+                if (ends[i] == i + 1) {
+                    const string& value = *nodes[i]->internedValue();
+                    *p++ = ' ';
+                    memcpy(p, value.data(), value.size());
+                    p += value.size();
+                    *p = '\n';
+                    continue;
+                }
+                *p = '\n';
+                size_t prefixSize = UNIT.size() * depths[i] + BRANCH.size();
+                const char* prefixStart = prefix.data() + prefix.size() - prefixSize;
+                for (size_t child = i + 1; child < ends[i]; child = ends[child]) {
+                    memcpy(out + offsets[child] - prefixSize, prefixStart, prefixSize);
+                }
+                char* closing = out + offsets[i] + sizes[i] - (prefixSize - BRANCH.size()) - 1;
+                memcpy(closing, indent.data(), prefixSize - BRANCH.size());
+                closing[prefixSize - BRANCH.size()] = '\n';
+            }
+        }
+    };
+
+    int count = min((size_t) threads, (nodes.size() + block - 1) / block);
+    vector<thread> workers;
+    for (int t = 1; t < count; t++) {
+        workers.push_back(thread(work));
+    }
+    work();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Print a tree
+ * @param root The tree
+ * @return The same text as root->tostring()
+ */
+string TreeRenderer::render(ParseTree* root) {
+    return render(vector<ParseTree*>(1, root));
+}
+
+/**
+ * Print trees one after another
+ * @param roots The trees
+ * @return The same text as each tree's tostring(), concatenated
+ */
+string TreeRenderer::render(const vector<ParseTree*>& roots) {
+    layout(roots);
+    MemoryStats::allocate(MemoryStats::OUTPUT_BUFFERS, total);
+    string output;
+    try {
+        output.resize(total);
+    } catch (...) {
+        MemoryStats::release(MemoryStats::OUTPUT_BUFFERS, total);
+        throw;
+    }
+    fill(&output[0]);
+    MemoryStats::release(MemoryStats::OUTPUT_BUFFERS, total);
+    return output;
+}
+
+/**
+ * Print trees one after another straight into a file. The file's blocks
+ * are allocated once and filled through a shared mapping, so the text is
+ * never copied.
+ * @param roots The trees
+ * @param path The file to write
+ * @return true if the file was written, false otherwise
+ */
+bool TreeRenderer::renderToFile(const vector<ParseTree*>& roots, const string& path) {
+    layout(roots);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (total == 0) {
+        return close(fd) == 0;
+    }
+    // Allocating the blocks up front means a full disk fails here instead
+    // of raising SIGBUS while the mapping is filled
+    if (posix_fallocate(fd, 0, total) != 0) {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    fill((char*) mapped);
+    bool ok = munmap(mapped, total) == 0;
+    return close(fd) == 0 && ok;
+}
+
+/**
+ * Get the size of the last output
+ * @return The number of bytes
+ */
+size_t TreeRenderer::getSize() {
+    return total;
+}
@@ -0,0 +1,47 @@
+#ifndef TREERENDERER_H
+#define TREERENDERER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ParseTree.h"
+
+/**
+ * Prints parse trees in the ParseTree::tostring() format on several
+ * threads. One walk computes the exact size of every subtree's output,
+ * which fixes where each node's text goes in a single preallocated buffer;
+ * the nodes are then split between threads, each writing its own disjoint
+ * bytes. A file is written through one shared mapping of its final size.
+ */
+class TreeRenderer {
+    private:
+        int threads;
+        // The trees' nodes in the order they are printed, with their
+        // depth, the index after their subtree, their subtree's output
+        // size, and where their own output starts
+        std::vector<ParseTree*> nodes;
+        std::vector<int> depths;
+        std::vector<std::size_t> ends;
+        std::vector<std::size_t> sizes;
+        std::vector<std::size_t> offsets;
+        std::size_t total;
+        // Bytes of the vectors above charged to the memory budget
+        std::size_t layoutBytes;
+
+        void reserveNodes(std::size_t count);
+        void layout(const std::vector<ParseTree*>& roots);
+        void fill(char* out);
+
+    public:
+        TreeRenderer(int threads);
+        ~TreeRenderer();
+
+        std::string render(ParseTree* root);
+        std::string render(const std::vector<ParseTree*>& roots);
+        bool renderToFile(const std::vector<ParseTree*>& roots, const std::string& path);
+
+        std::size_t getSize();
+};
+
+#endif /*TREERENDERER_H*/
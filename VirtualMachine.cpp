@@ -0,0 +1,730 @@
+#include "VirtualMachine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+using namespace std;
+
+/** Mask keeping computed addresses inside the 32K words of RAM */
+static const int ADDRESS_MASK = 0x7FFF;
+
+/** Thrown by Sys.halt to stop the program */
+struct HaltRequest {};
+
+/** Names and argument counts of the built-in OS subroutines, in Builtin order */
+static const struct {
+    const char* name;
+    int arguments;
+} BUILTINS[] = {
+    {"Math.multiply", 2}, {"Math.divide", 2}, {"Math.min", 2}, {"Math.max", 2}, {"Math.abs", 1}, {"Math.sqrt", 1},
+    {"Memory.peek", 1}, {"Memory.poke", 2}, {"Memory.alloc", 1}, {"Memory.deAlloc", 1},
+    {"Array.new", 1}, {"Array.dispose", 1},
+    {"String.new", 1}, {"String.dispose", 1}, {"String.length", 1}, {"String.charAt", 2}, {"String.setCharAt", 3},
+    {"String.appendChar", 2}, {"String.eraseLastChar", 1},
+    {"Output.printInt", 1}, {"Output.printChar", 1}, {"Output.printString", 1}, {"Output.println", 0},
+    {"Sys.halt", 0}, {"Sys.error", 1},
+};
+
+/**
+ * Truncate a value to a signed 16-bit Hack word
+ * @param value The value to wrap
+ * @return The wrapped value
+ */
+static int16_t wrap(int value) {
+    return (int16_t) (uint16_t) (value & 0xFFFF);
+}
+
+/**
+ * Turn a word into a RAM address
+ * @param word The word
+ * @return The address
+ */
+static int address(int16_t word) {
+    return (uint16_t) word & ADDRESS_MASK;
+}
+
+/**
+ * Parse a non-negative VM operand
+ * @param text The operand
+ * @return The value, or -1 if it is not a non-negative number
+ */
+static int operand(const string& text) {
+    if (text.empty() || text.size() > 9 || text.find_first_not_of("0123456789") != string::npos) {
+        return -1;
+    }
+    return atoi(text.c_str());
+}
+
+/**
+ * Constructor for the VirtualMachine
+ */
+VirtualMachine::VirtualMachine() {
+    instructions = 0;
+    seconds = 0;
+}
+
+/**
+ * Get the ID of a function, creating one for names not seen before
+ * @param name The function's full name, such as Main.main
+ * @return The function's ID
+ */
+int VirtualMachine::functionId(const string& name) {
+    map<string, int>::iterator it = functionIds.find(name);
+    if (it != functionIds.end()) {
+        return it->second;
+    }
+    int id = functionNames.size();
+    functionIds[name] = id;
+    functionNames.push_back(name);
+    functionAddresses.push_back(-1);
+    return id;
+}
+
+/**
+ * Get the RAM address of a static variable, assigning one on first use
+ * @param className The class the variable belongs to
+ * @param index The variable's index in the class's static segment
+ * @return The address
+ */
+int VirtualMachine::staticAddress(const string& className, int index) {
+    string key = className + "." + to_string(index);
+    map<string, int>::iterator it = staticAddresses.find(key);
+    if (it != staticAddresses.end()) {
+        return it->second;
+    }
+    int address = STATIC_BASE + staticAddresses.size();
+    if (address >= STATIC_END) {
+        throw VMException("too many static variables");
+    }
+    staticAddresses[key] = address;
+    return address;
+}
+
+/**
+ * Find a built-in OS subroutine
+ * @param name The subroutine's full name
+ * @param arguments Set to the number of arguments it takes
+ * @return The subroutine's Builtin ID, or -1 if there is none
+ */
+int VirtualMachine::builtinId(const string& name, int& arguments) {
+    for (int i = 0; i < NUM_BUILTINS; i++) {
+        if (name == BUILTINS[i].name) {
+            arguments = BUILTINS[i].arguments;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Lower VM code to bytecode and add it to the program. Labels are local to
+ * the function they appear in, and static variables to the class named by
+ * the function.
+ * @param vmCode VM commands, one per line
+ */
+void VirtualMachine::load(const string& vmCode) {
+    istringstream lines(vmCode);
+    string line;
+    int lineNumber = 0;
+    string function;
+    int functionStart = -1;
+    int depth = 0;
+    int maxDepth = 0;
+    map<string, int> labels;
+    map<string, int> labelDepths;
+    vector<pair<size_t, string>> jumps;
+
+    while (getline(lines, line)) {
+        lineNumber++;
+        string where = "line " + to_string(lineNumber) + ": ";
+        istringstream words(line.substr(0, line.find("//")));
+        vector<string> command;
+        string word;
+        while (words >> word) {
+            command.push_back(word);
+        }
+        if (command.empty()) {
+            continue;
+        }
+        const string& name = command[0];
+        if (function.empty() && name != "function") {
+            throw VMException(where + "command outside a function");
+        }
+
+        Instruction instruction = {HALT, 0, 0};
+        int effect = 0;
+        int pops = 0;
+        if (name == "push" || name == "pop") {
+            bool push = name == "push";
+            int index = command.size() == 3 ? operand(command[2]) : -1;
+            const string& segment = command.size() == 3 ? command[1] : "";
+            instruction.a = index;
+            effect = push ? 1 : -1;
+            pops = push ? 0 : 1;
+            if (index < 0) {
+                throw VMException(where + "expected a segment and index");
+            } else if (segment == "constant" && push && index <= 32767) {
+                instruction.op = PUSH_CONSTANT;
+            } else if (segment == "local") {
+                instruction.op = push ? PUSH_LOCAL : POP_LOCAL;
+            } else if (segment == "argument") {
+                instruction.op = push ? PUSH_ARGUMENT : POP_ARGUMENT;
+            } else if (segment == "this") {
+                instruction.op = push ? PUSH_THIS : POP_THIS;
+            } else if (segment == "that") {
+                instruction.op = push ? PUSH_THAT : POP_THAT;
+            } else if (segment == "pointer" && index <= 1) {
+                instruction.op = push ? PUSH_POINTER : POP_POINTER;
+            } else if (segment == "temp" && index <= 7) {
+                instruction.op = push ? PUSH_TEMP : POP_TEMP;
+                instruction.a = 5 + index;
+            } else if (segment == "static") {
+                instruction.op = push ? PUSH_STATIC : POP_STATIC;
+                instruction.a = staticAddress(function.substr(0, function.find('.')), index);
+            } else {
+                throw VMException(where + "invalid " + name + " " + segment + " " + command[2]);
+            }
+        } else if (name == "add" || name == "sub" || name == "eq" || name == "gt" || name == "lt" || name == "and" || name == "or") {
+            instruction.op = name == "add" ? ADD : name == "sub" ? SUB : name == "eq" ? EQ : name == "gt" ? GT
+                : name == "lt" ? LT : name == "and" ? AND : OR;
+            effect = -1;
+            pops = 2;
+        } else if (name == "neg" || name == "not") {
+            instruction.op = name == "neg" ? NEG : NOT;
+            pops = 1;
+        } else if (name == "label" || name == "goto" || name == "if-goto") {
+            if (command.size() != 2) {
+                throw VMException(where + "expected a label");
+            }
+            string label = function + "$" + command[1];
+            if (name == "label") {
+                if (labels.count(label) != 0) {
+                    throw VMException(where + "label " + command[1] + " is defined twice");
+                }
+                labels[label] = code.size();
+                labelDepths[label] = depth;
+                continue;
+            }
+            instruction.op = name == "goto" ? GOTO : IF_GOTO;
+            effect = name == "goto" ? 0 : -1;
+            pops = -effect;
+            jumps.push_back(make_pair(code.size(), label));
+        } else if (name == "function" || name == "call") {
+            int count = command.size() == 3 ? operand(command[2]) : -1;
+            if (count < 0) {
+                throw VMException(where + "expected a name and count");
+            }
+            int id = functionId(command[1]);
+            if (name == "call") {
+                instruction = Instruction{CALL, id, count};
+                effect = 1 - count;
+                pops = count;
+            } else {
+                if (functionAddresses[id] >= 0) {
+                    throw VMException(where + "function " + command[1] + " is defined twice");
+                }
+                if (functionStart >= 0) {
+                    code[functionStart].b = maxDepth;
+                }
+                function = command[1];
+                functionStart = code.size();
+                functionAddresses[id] = functionStart;
+                depth = 0;
+                maxDepth = 0;
+                instruction = Instruction{FUNCTION, count, 0};
+            }
+        } else if (name == "return") {
+            instruction.op = RETURN;
+            effect = -1;
+            pops = 1;
+        } else {
+            throw VMException(where + "unknown command " + name);
+        }
+        if (depth < pops) {
+            throw VMException(where + name + " would pop past the bottom of the stack");
+        }
+        depth += effect;
+        if (instruction.op == GOTO || instruction.op == IF_GOTO) {
+            // Checked against the label's depth once every label is known
+            instruction.b = depth;
+        }
+        code.push_back(instruction);
+        maxDepth = max(maxDepth, depth);
+    }
+    if (functionStart >= 0) {
+        code[functionStart].b = maxDepth;
+    }
+
+    for (const pair<size_t, string>& jump : jumps) {
+        map<string, int>::iterator target = labels.find(jump.second);
+        if (target == labels.end()) {
+            throw VMException("label " + jump.second + " is not defined");
+        }
+        // Every path to a label must leave the same number of values on the
+        // stack, so a loop cannot grow or drain the stack as it runs
+        if (code[jump.first].b != labelDepths[jump.second]) {
+            throw VMException("label " + jump.second + " is reached with different stack depths");
+        }
+        code[jump.first].a = target->second;
+    }
+}
+
+/**
+ * Run a program from a function taking no arguments. Calls are linked
+ * first, to loaded functions or else to the built-in OS.
+ * @param entry The function to call, such as Main.main
+ * @return The value the function returned
+ */
+int VirtualMachine::run(const string& entry) {
+    map<string, int>::iterator id = functionIds.find(entry);
+    if (id == functionIds.end() || functionAddresses[id->second] < 0) {
+        throw VMException("function " + entry + " is not defined");
+    }
+
+    vector<Instruction> program(code);
+    for (Instruction& instruction : program) {
+        if (instruction.op != CALL || functionAddresses[instruction.a] >= 0) {
+            if (instruction.op == CALL) {
+                instruction.a = functionAddresses[instruction.a];
+            }
+            continue;
+        }
+        const string& name = functionNames[instruction.a];
+        int arguments = 0;
+        int builtin = builtinId(name, arguments);
+        if (builtin < 0) {
+            throw VMException("function " + name + " is not defined");
+        }
+        if (arguments != instruction.b) {
+            throw VMException(name + " takes " + to_string(arguments) + " arguments");
+        }
+        instruction.op = CALL_BUILTIN;
+        instruction.a = builtin;
+    }
+    int start = program.size();
+    program.push_back(Instruction{CALL, functionAddresses[id->second], 0});
+    program.push_back(Instruction{HALT, 0, 0});
+
+    ram.assign(RAM_SIZE, 0);
+    freeBlocks.clear();
+    freeBlocks[(int) STACK_END] = HEAP_END - STACK_END;
+    output.clear();
+    instructions = 0;
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    int result = 0;
+    try {
+        result = execute(program, start);
+    } catch (HaltRequest& halt) {
+    }
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return result;
+}
+
+/**
+ * The interpreter loop. Registers live in locals while it runs and are
+ * written to RAM 0-4 around built-in calls, which may read or change them.
+ * @param program The linked bytecode
+ * @param start The index of the first instruction to run
+ * @return The value on top of the stack when the program halts
+ */
+int VirtualMachine::execute(vector<Instruction>& program, int start) {
+    int16_t* m = ram.data();
+    const Instruction* base = program.data();
+    const Instruction* ip = base + start;
+    int sp = STACK_BASE;
+    int lcl = STACK_BASE;
+    int arg = STACK_BASE;
+    int thisp = 0;
+    int that = 0;
+    uint64_t count = 0;
+    // Return addresses are kept apart from RAM, which cannot hold them
+    vector<int> returns((STACK_END - STACK_BASE) / 5 + 1);
+    int depth = 0;
+
+#ifdef VM_COMPUTED_GOTO
+    static void* targets[] = {
+        &&L_PUSH_CONSTANT, &&L_PUSH_LOCAL, &&L_PUSH_ARGUMENT, &&L_PUSH_THIS, &&L_PUSH_THAT, &&L_PUSH_POINTER,
+        &&L_PUSH_TEMP, &&L_PUSH_STATIC,
+        &&L_POP_LOCAL, &&L_POP_ARGUMENT, &&L_POP_THIS, &&L_POP_THAT, &&L_POP_POINTER, &&L_POP_TEMP, &&L_POP_STATIC,
+        &&L_ADD, &&L_SUB, &&L_NEG, &&L_EQ, &&L_GT, &&L_LT, &&L_AND, &&L_OR, &&L_NOT,
+        &&L_GOTO, &&L_IF_GOTO, &&L_CALL, &&L_CALL_BUILTIN, &&L_FUNCTION, &&L_RETURN, &&L_HALT
+    };
+#define CASE(name) L_##name:
+#define NEXT() { const Instruction* current = ip++; count++; goto *targets[current->op]; }
+#define OPERAND_A (ip[-1].a)
+#define OPERAND_B (ip[-1].b)
+    NEXT();
+#else
+#define CASE(name) case name:
+#define NEXT() break
+#define OPERAND_A (ip[-1].a)
+#define OPERAND_B (ip[-1].b)
+    while (true) {
+        count++;
+        switch ((ip++)->op) {
+#endif
+
+    CASE(PUSH_CONSTANT) m[sp++] = OPERAND_A; NEXT();
+    CASE(PUSH_LOCAL) m[sp++] = m[(lcl + OPERAND_A) & ADDRESS_MASK]; NEXT();
+    CASE(PUSH_ARGUMENT) m[sp++] = m[(arg + OPERAND_A) & ADDRESS_MASK]; NEXT();
+    CASE(PUSH_THIS) m[sp++] = m[(thisp + OPERAND_A) & ADDRESS_MASK]; NEXT();
+    CASE(PUSH_THAT) m[sp++] = m[(that + OPERAND_A) & ADDRESS_MASK]; NEXT();
+    CASE(PUSH_POINTER) m[sp++] = OPERAND_A == 0 ? thisp : that; NEXT();
+    CASE(PUSH_TEMP) m[sp++] = m[OPERAND_A]; NEXT();
+    CASE(PUSH_STATIC) m[sp++] = m[OPERAND_A]; NEXT();
+
+    CASE(POP_LOCAL) m[(lcl + OPERAND_A) & ADDRESS_MASK] = m[--sp]; NEXT();
+    CASE(POP_ARGUMENT) m[(arg + OPERAND_A) & ADDRESS_MASK] = m[--sp]; NEXT();
+    CASE(POP_THIS) m[(thisp + OPERAND_A) & ADDRESS_MASK] = m[--sp]; NEXT();
+    CASE(POP_THAT) m[(that + OPERAND_A) & ADDRESS_MASK] = m[--sp]; NEXT();
+    CASE(POP_POINTER) {
+        sp--;
+        if (OPERAND_A == 0) {
+            thisp = address(m[sp]);
+        } else {
+            that = address(m[sp]);
+        }
+        NEXT();
+    }
+    CASE(POP_TEMP) m[OPERAND_A] = m[--sp]; NEXT();
+    CASE(POP_STATIC) m[OPERAND_A] = m[--sp]; NEXT();
+
+    CASE(ADD) sp--; m[sp - 1] = wrap(m[sp - 1] + m[sp]); NEXT();
+    CASE(SUB) sp--; m[sp - 1] = wrap(m[sp - 1] - m[sp]); NEXT();
+    CASE(NEG) m[sp - 1] = wrap(-m[sp - 1]); NEXT();
+    CASE(EQ) sp--; m[sp - 1] = m[sp - 1] == m[sp] ? -1 : 0; NEXT();
+    CASE(GT) sp--; m[sp - 1] = m[sp - 1] > m[sp] ? -1 : 0; NEXT();
+    CASE(LT) sp--; m[sp - 1] = m[sp - 1] < m[sp] ? -1 : 0; NEXT();
+    CASE(AND) sp--; m[sp - 1] &= m[sp]; NEXT();
+    CASE(OR) sp--; m[sp - 1] |= m[sp]; NEXT();
+    CASE(NOT) m[sp - 1] = ~m[sp - 1]; NEXT();
+
+    CASE(GOTO) ip = base + OPERAND_A; NEXT();
+    CASE(IF_GOTO) {
+        if (m[--sp] != 0) {
+            ip = base + OPERAND_A;
+        }
+        NEXT();
+    }
+    CASE(CALL) {
+        if (sp + 5 > STACK_END) {
+            throw VMException("stack overflow");
+        }
+        returns[depth++] = ip - base;
+        m[sp] = 0;
+        m[sp + 1] = lcl;
+        m[sp + 2] = arg;
+        m[sp + 3] = thisp;
+        m[sp + 4] = that;
+        arg = sp - OPERAND_B;
+        sp += 5;
+        lcl = sp;
+        ip = base + OPERAND_A;
+        NEXT();
+    }
+    CASE(CALL_BUILTIN) {
+        int arguments = OPERAND_B;
+        m[0] = sp;
+        m[1] = lcl;
+        m[2] = arg;
+        m[3] = thisp;
+        m[4] = that;
+        int16_t result = builtin(OPERAND_A, m + sp - arguments);
+        lcl = address(m[1]);
+        arg = address(m[2]);
+        thisp = address(m[3]);
+        that = address(m[4]);
+        sp -= arguments;
+        m[sp++] = result;
+        NEXT();
+    }
+    CASE(FUNCTION) {
+        // b is the most the function's own expressions push
+        if (sp + OPERAND_A + OPERAND_B > STACK_END) {
+            throw VMException("stack overflow");
+        }
+        for (int i = OPERAND_A; i > 0; i--) {
+            m[sp++] = 0;
+        }
+        NEXT();
+    }
+    CASE(RETURN) {
+        int frame = lcl;
+        m[arg] = m[sp - 1];
+        sp = arg + 1;
+        that = address(m[frame - 1]);
+        thisp = address(m[frame - 2]);
+        arg = address(m[frame - 3]);
+        lcl = address(m[frame - 4]);
+        ip = base + returns[--depth];
+        NEXT();
+    }
+    CASE(HALT) {
+        instructions = count;
+        return m[sp - 1];
+    }
+
+#ifndef VM_COMPUTED_GOTO
+        }
+    }
+#endif
+#undef CASE
+#undef NEXT
+#undef OPERAND_A
+#undef OPERAND_B
+}
+
+/**
+ * Run a built-in OS subroutine
+ * @param id The subroutine's Builtin ID
+ * @param args The subroutine's arguments, on the stack
+ * @return The subroutine's result, or 0 for a void subroutine
+ */
+int16_t VirtualMachine::builtin(int id, int16_t* args) {
+    int16_t* m = ram.data();
+    switch (id) {
+        case MATH_MULTIPLY:
+            return wrap(args[0] * args[1]);
+        case MATH_DIVIDE:
+            if (args[1] == 0) {
+                throw VMException("Math.divide: division by zero");
+            }
+            return wrap(args[0] / args[1]);
+        case MATH_MIN:
+            return min(args[0], args[1]);
+        case MATH_MAX:
+            return max(args[0], args[1]);
+        case MATH_ABS:
+            return wrap(abs(args[0]));
+        case MATH_SQRT: {
+            if (args[0] < 0) {
+                throw VMException("Math.sqrt: negative argument");
+            }
+            int root = 0;
+            while ((root + 1) * (root + 1) <= args[0]) {
+                root++;
+            }
+            return root;
+        }
+        case MEMORY_PEEK:
+            return m[address(args[0])];
+        case MEMORY_POKE:
+            // SP, LCL and ARG are kept in registers that must stay in step
+            // with the return addresses, so only THIS and THAT may be moved
+            if (address(args[0]) < 3) {
+                throw VMException("Memory.poke: cannot change SP, LCL or ARG");
+            }
+            m[address(args[0])] = args[1];
+            return 0;
+        case MEMORY_ALLOC:
+        case ARRAY_NEW:
+            return allocate(args[0]);
+        case MEMORY_DEALLOC:
+        case ARRAY_DISPOSE:
+        case STRING_DISPOSE:
+            deallocate(address(args[0]));
+            return 0;
+        case STRING_NEW: {
+            if (args[0] < 0) {
+                throw VMException("String.new: negative length");
+            }
+            int16_t s = allocate(args[0] + 2);
+            m[s] = args[0];
+            m[s + 1] = 0;
+            return s;
+        }
+        case STRING_LENGTH:
+            return m[stringAddress(args[0], id) + 1];
+        case STRING_CHAR_AT:
+        case STRING_SET_CHAR_AT: {
+            int s = stringAddress(args[0], id);
+            if (args[1] < 0 || args[1] >= m[s + 1]) {
+                throw VMException(string(BUILTINS[id].name) + ": index out of range");
+            }
+            if (id == STRING_CHAR_AT) {
+                return m[s + 2 + args[1]];
+            }
+            m[s + 2 + args[1]] = args[2];
+            return 0;
+        }
+        case STRING_APPEND_CHAR: {
+            int s = stringAddress(args[0], id);
+            if (m[s + 1] >= m[s]) {
+                throw VMException("String.appendChar: string is full");
+            }
+            m[s + 2 + m[s + 1]++] = args[1];
+            return args[0];
+        }
+        case STRING_ERASE_LAST_CHAR: {
+            int s = stringAddress(args[0], id);
+            if (m[s + 1] <= 0) {
+                throw VMException("String.eraseLastChar: string is empty");
+            }
+            m[s + 1]--;
+            return 0;
+        }
+        case OUTPUT_PRINT_INT:
+            output += to_string(args[0]);
+            return 0;
+        case OUTPUT_PRINT_CHAR:
+            output += (char) args[0];
+            return 0;
+        case OUTPUT_PRINT_STRING: {
+            int s = stringAddress(args[0], id);
+            for (int i = 0; i < m[s + 1]; i++) {
+                output += (char) m[s + 2 + i];
+            }
+            return 0;
+        }
+        case OUTPUT_PRINTLN:
+            output += '\n';
+            return 0;
+        case SYS_HALT:
+            throw HaltRequest();
+        default:
+            throw VMException("Sys.error(" + to_string(args[0]) + ")");
+    }
+}
+
+/**
+ * Check that a word points at a string: a capacity and a length no larger
+ * than it, followed by that many characters, all inside RAM
+ * @param word The string's address
+ * @param id The Builtin ID of the subroutine it was passed to
+ * @return The string's address in RAM
+ */
+int VirtualMachine::stringAddress(int16_t word, int id) {
+    int s = address(word);
+    if (s + 2 > RAM_SIZE || ram[s] < 0 || ram[s + 1] < 0 || ram[s + 1] > ram[s] || s + 2 + ram[s] > RAM_SIZE) {
+        throw VMException(string(BUILTINS[id].name) + ": not a string");
+    }
+    return s;
+}
+
+/**
+ * Allocate a heap block, first fit. The word before the block holds its size.
+ * @param size The number of words wanted
+ * @return The block's address
+ */
+int16_t VirtualMachine::allocate(int size) {
+    if (size <= 0) {
+        throw VMException("Memory.alloc: size must be positive");
+    }
+    int needed = size + 1;
+    for (map<int, int>::iterator it = freeBlocks.begin(); it != freeBlocks.end(); it++) {
+        if (it->second < needed) {
+            continue;
+        }
+        int start = it->first;
+        int remaining = it->second - needed;
+        freeBlocks.erase(it);
+        if (remaining > 0) {
+            freeBlocks[start + needed] = remaining;
+        }
+        ram[start] = needed;
+        return start + 1;
+    }
+    throw VMException("Memory.alloc: heap overflow");
+}
+
+/**
+ * Return a heap block, merging it with free neighbours
+ * @param address The block's address, as returned by allocate()
+ */
+void VirtualMachine::deallocate(int address) {
+    int start = address - 1;
+    int size = ram[start & ADDRESS_MASK];
+    if (start < STACK_END || size < 2 || start + size > HEAP_END) {
+        throw VMException("Memory.deAlloc: not a heap block");
+    }
+    map<int, int>::iterator next = freeBlocks.lower_bound(start);
+    if (next != freeBlocks.end() && next->first < start + size) {
+        throw VMException("Memory.deAlloc: block is already free");
+    }
+    if (next != freeBlocks.begin()) {
+        map<int, int>::iterator previous = prev(next);
+        if (previous->first + previous->second > start) {
+            throw VMException("Memory.deAlloc: block is already free");
+        }
+        if (previous->first + previous->second == start) {
+            start = previous->first;
+            size += previous->second;
+            freeBlocks.erase(previous);
+        }
+    }
+    if (next != freeBlocks.end() && next->first == start + size) {
+        size += next->second;
+        freeBlocks.erase(next);
+    }
+    freeBlocks[start] = size;
+}
+
+/**
+ * Get the text written by Output during the last run
+ * @return The output
+ */
+string VirtualMachine::getOutput() {
+    return output;
+}
+
+/**
+ * Get the number of instructions executed by the last run
+ * @return The instruction count
+ */
+uint64_t VirtualMachine::getInstructions() {
+    return instructions;
+}
+
+/**
+ * Get how long the last run took
+ * @return The time in seconds
+ */
+double VirtualMachine::getSeconds() {
+    return seconds;
+}
+
+/**
+ * Generate a report of the last run's speed
+ * @return A printable summary
+ */
+string VirtualMachine::report() {
+    ostringstream out;
+    out << "vm: " << instructions << " instructions in " << seconds * 1000 << " ms, "
+        << (seconds > 0 ? instructions / seconds / 1e6 : 0) << " M instructions/s ("
+        << dispatchMethod() << " dispatch)\n";
+    return out.str();
+}
+
+/**
+ * Get how the interpreter loop dispatches instructions in this build
+ * @return "computed goto" or "switch"
+ */
+const char* VirtualMachine::dispatchMethod() {
+#ifdef VM_COMPUTED_GOTO
+    return "computed goto";
+#else
+    return "switch";
+#endif
+}
+
+/**
+ * Constructor for a VMException
+ * @param message What went wrong
+ */
+VMException::VMException(string message) {
+    VMException::message = message;
+}
+
+/**
+ * Definition of a VMException
+ * Thrown when VM code cannot be loaded or a program fails while running.
+ */
+const char* VMException::what() const noexcept {
+    return message.c_str();
+}
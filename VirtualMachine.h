@@ -0,0 +1,98 @@
+#ifndef VIRTUALMACHINE_H
+#define VIRTUALMACHINE_H
+
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * In-process Hack VM. VM code is lowered to a compact bytecode with jump
+ * targets, static addresses and call targets resolved ahead of time, and
+ * run with computed-goto dispatch where the compiler supports it (a switch
+ * elsewhere). Memory follows the Hack layout: 32K 16-bit words with the
+ * stack from 256 and the heap from 2048. The OS classes Math, Memory,
+ * Array, String, Output and Sys are built in; a loaded function with the
+ * same name takes their place.
+ */
+class VirtualMachine {
+    public:
+        VirtualMachine();
+
+        void load(const std::string& vmCode);
+        int run(const std::string& entry);
+
+        std::string getOutput();
+        uint64_t getInstructions();
+        double getSeconds();
+        std::string report();
+
+        static const char* dispatchMethod();
+
+    private:
+        enum Opcode {
+            PUSH_CONSTANT, PUSH_LOCAL, PUSH_ARGUMENT, PUSH_THIS, PUSH_THAT, PUSH_POINTER, PUSH_TEMP, PUSH_STATIC,
+            POP_LOCAL, POP_ARGUMENT, POP_THIS, POP_THAT, POP_POINTER, POP_TEMP, POP_STATIC,
+            ADD, SUB, NEG, EQ, GT, LT, AND, OR, NOT,
+            GOTO, IF_GOTO, CALL, CALL_BUILTIN, FUNCTION, RETURN, HALT
+        };
+
+        enum Builtin {
+            MATH_MULTIPLY, MATH_DIVIDE, MATH_MIN, MATH_MAX, MATH_ABS, MATH_SQRT,
+            MEMORY_PEEK, MEMORY_POKE, MEMORY_ALLOC, MEMORY_DEALLOC,
+            ARRAY_NEW, ARRAY_DISPOSE,
+            STRING_NEW, STRING_DISPOSE, STRING_LENGTH, STRING_CHAR_AT, STRING_SET_CHAR_AT,
+            STRING_APPEND_CHAR, STRING_ERASE_LAST_CHAR,
+            OUTPUT_PRINT_INT, OUTPUT_PRINT_CHAR, OUTPUT_PRINT_STRING, OUTPUT_PRINTLN,
+            SYS_HALT, SYS_ERROR,
+            NUM_BUILTINS
+        };
+
+        /** One bytecode instruction; a and b are its operands */
+        struct Instruction {
+            int32_t op;
+            int32_t a;
+            int32_t b;
+        };
+
+        static const int RAM_SIZE = 32768;
+        static const int STACK_BASE = 256;
+        static const int STACK_END = 2048;
+        static const int HEAP_END = 16384;
+        static const int STATIC_BASE = 16;
+        static const int STATIC_END = 256;
+
+        std::vector<Instruction> code;
+        std::vector<std::string> functionNames;
+        std::map<std::string, int> functionIds;
+        std::vector<int> functionAddresses;
+        std::map<std::string, int> staticAddresses;
+
+        std::vector<int16_t> ram;
+        std::map<int, int> freeBlocks;
+        std::string output;
+        uint64_t instructions;
+        double seconds;
+
+        int functionId(const std::string& name);
+        int staticAddress(const std::string& className, int index);
+        static int builtinId(const std::string& name, int& arguments);
+
+        int execute(std::vector<Instruction>& program, int start);
+        int16_t builtin(int id, int16_t* args);
+        int stringAddress(int16_t word, int id);
+        int16_t allocate(int size);
+        void deallocate(int address);
+};
+
+class VMException : public std::exception {
+    private:
+        std::string message;
+
+    public:
+        VMException(std::string message);
+        const char* what() const noexcept;
+};
+
+#endif /*VIRTUALMACHINE_H*/